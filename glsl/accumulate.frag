@@ -0,0 +1,11 @@
+in vec2 FsTexCoords;
+layout(location = 0) out vec4 Accum;
+
+layout(location = 0) uniform sampler2D uSampleTex;
+
+// Blended additively: rgb sums the samples, alpha sums their squared luminance
+void main() {
+    vec3 color = texelFetch(uSampleTex, ivec2(gl_FragCoord.xy), 0).rgb;
+    float luma = dot(color, vec3(0.2126, 0.7152, 0.0722));
+    Accum = vec4(color, luma * luma);
+}
\ No newline at end of file
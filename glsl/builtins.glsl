@@ -2,11 +2,13 @@
 
 layout(std140, binding = 0) uniform mainBlock {
     vec4 uMouse;       // xy = current, zw = click
-    vec3 uResolution;  // Viewport res
+    vec4 uTile;        // xy = pixel offset, zw = size of the rendered tile
+    vec3 uResolution;  // Viewport res, whole image when tiled
     float uTime;       // Shader playback (seconds)
     float uTimeDelta;  // Render time (seconds)
     float uFrameRate;  // Frame rate
     int uFrame;        // Number of the frame
+    int uSample;       // Samples accumulated so far, the frame number when not accumulating
 };
 
 layout(location = 0) uniform sampler2D uTexture0;
@@ -17,4 +19,10 @@ layout(location = 3) uniform sampler2D uTexture3;
 layout(location = 4) uniform samplerCube uCube0;
 layout(location = 5) uniform samplerCube uCube1;
 layout(location = 6) uniform samplerCube uCube2;
-layout(location = 7) uniform samplerCube uCube3;
\ No newline at end of file
+layout(location = 7) uniform samplerCube uCube3;
+
+// Buffer passes, last output of bufferA..D.glsl
+layout(location = 8) uniform sampler2D uBufferA;
+layout(location = 9) uniform sampler2D uBufferB;
+layout(location = 10) uniform sampler2D uBufferC;
+layout(location = 11) uniform sampler2D uBufferD;
\ No newline at end of file
@@ -7,6 +7,6 @@ void mainImage(out vec4 color, in vec2 pixel);
 
 void main() {
     vec4 color = vec4(0, 0, 0, 1);
-    mainImage(color, FsTexCoords.xy * uResolution.xy);
+    mainImage(color, uTile.xy + FsTexCoords.xy * uTile.zw);
     FragColor = color;
 }
\ No newline at end of file
@@ -0,0 +1,15 @@
+in vec2 FsTexCoords;
+layout(location = 0) out vec4 FragColor;
+
+layout(location = 0) uniform sampler2D uAccum;
+layout(location = 1) uniform float uInvSamples;
+
+// Narkowicz's ACES fit
+vec3 ACESFilm(vec3 x) {
+    return clamp((x * (2.51 * x + 0.03)) / (x * (2.43 * x + 0.59) + 0.14), 0.0, 1.0);
+}
+
+void main() {
+    vec3 mean = texture(uAccum, FsTexCoords).rgb * uInvSamples;
+    FragColor = vec4(pow(ACESFilm(mean), vec3(1.0 / 2.2)), 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,140 @@
+#include <accumulator.h>
+#include <graphics.h>
+
+#include <glad/glad.h>
+
+#include <bit>
+
+using namespace sdbox;
+
+namespace {
+
+constexpr int StatsDepth = 2;
+
+// Readback frame ids carry the epoch they were taken in and the check number
+constexpr int CheckId(int epoch, int samples) {
+    return ((epoch & 0x7fff) << 16) | ((samples / Accumulator::CheckInterval) & 0xffff);
+}
+
+std::unique_ptr<Program> BuiltinProgram(const std::string& name, const std::string& fragFile) {
+    std::array<std::string, 2> sources = {
+        (ShaderFolder / "simple.vert").string(), (ShaderFolder / fragFile).string()};
+
+    auto prog = CompileAndLinkProgram(name, sources);
+    glProgramUniform1i(prog->id(), 0, Accumulator::TextureUnit);
+    return prog;
+}
+
+} // namespace
+
+Accumulator::Accumulator(ThreadPool& pool, int maxSamples, float tolerance)
+    : maxSamples(maxSamples), tolerance(tolerance), pool(pool) {
+    accumProg   = BuiltinProgram("accumulate", "accumulate.frag");
+    tonemapProg = BuiltinProgram("tonemap", "tonemap.frag");
+}
+
+void Accumulator::resize(int width, int height) {
+    const ImageFormat fmt{.width = width, .height = height, .nChannels = 4};
+
+    // Pending checks read from the old target
+    stats.reset();
+
+    sample = std::make_unique<RenderTarget>(fmt);
+    accum  = std::make_unique<RenderTarget>(fmt);
+    if (tolerance > 0.0f)
+        stats = std::make_unique<ReadbackRing>(fmt, StatsDepth, pool, [this](const auto& frame) {
+            checkError(frame);
+        });
+
+    reset();
+}
+
+void Accumulator::reset() {
+    numSamples = 0;
+    epoch      = (epoch + 1) & 0x7fff;
+    currentEpoch.store(epoch, std::memory_order_relaxed);
+
+    if (accum)
+        accum->clear();
+}
+
+void Accumulator::accumulate() {
+    accum->bind();
+
+    glEnable(GL_BLEND);
+    glBlendEquation(GL_FUNC_ADD);
+    glBlendFunc(GL_ONE, GL_ONE);
+
+    glUseProgram(accumProg->id());
+    glBindTextureUnit(TextureUnit, sample->texture().id());
+    RenderQuad();
+
+    glDisable(GL_BLEND);
+
+    ++numSamples;
+    if (stats && numSamples % CheckInterval == 0) {
+        stats->read(*accum, CheckId(epoch, numSamples));
+        stats->poll();
+    }
+}
+
+void Accumulator::resolve() const {
+    glUseProgram(tonemapProg->id());
+    glProgramUniform1f(tonemapProg->id(), 1, 1.0f / std::max(numSamples, 1));
+    glBindTextureUnit(TextureUnit, accum->texture().id());
+    RenderQuad();
+}
+
+float Accumulator::error() const {
+    const auto check = lastCheck.load(std::memory_order_acquire);
+    const int  id    = static_cast<int>(check >> 32);
+    if (check == 0 || (id >> 16) != epoch)
+        return std::numeric_limits<float>::infinity();
+
+    return std::bit_cast<float>(static_cast<std::uint32_t>(check));
+}
+
+bool Accumulator::converged() const {
+    if (maxSamples > 0 && numSamples >= maxSamples)
+        return true;
+
+    return tolerance > 0.0f && error() < tolerance;
+}
+
+void Accumulator::checkError(const ReadbackFrame& frame) {
+    // Started over since this was read back
+    const int checkEpoch = frame.frame >> 16;
+    if (checkEpoch != currentEpoch.load(std::memory_order_relaxed))
+        return;
+
+    const int    samples   = (frame.frame & 0xffff) * CheckInterval;
+    const double invN      = 1.0 / samples;
+    const auto   numPixels = static_cast<std::size_t>(frame.format.width) * frame.format.height;
+    const auto   pixels    = reinterpret_cast<const float*>(frame.pixels);
+
+    // Standard error of each pixel's mean luminance, relative to it
+    auto relError = [&](std::size_t begin, std::size_t end) {
+        double sum = 0.0;
+        for (auto p = pixels + begin * 4; p < pixels + end * 4; p += 4) {
+            const double mean = (0.2126 * p[0] + 0.7152 * p[1] + 0.0722 * p[2]) * invN;
+            const double var  = std::max(p[3] * invN - mean * mean, 0.0);
+            sum += std::sqrt(var * invN) / (mean + 1e-2);
+        }
+        return sum;
+    };
+
+    const double total = ParallelReduce(
+        0, numPixels, MinItemsPerTask, 0.0, relError, [](double a, double b) { return a + b; });
+
+    const auto error = static_cast<float>(total / numPixels);
+    const auto check = (static_cast<std::uint64_t>(frame.frame) << 32) |
+                       std::bit_cast<std::uint32_t>(error);
+    lastCheck.store(check, std::memory_order_release);
+}
+
+bool Accumulator::writeHDR(const fs::path& filePath) const {
+    const auto image = accum->texture().image();
+    return WritePFM(
+        filePath, image->format(), reinterpret_cast<const float*>(image->data()),
+        1.0f / std::max(numSamples, 1));
+}
\ No newline at end of file
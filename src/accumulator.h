@@ -0,0 +1,77 @@
+#ifndef SDBOX_ACCUMULATOR_H
+#define SDBOX_ACCUMULATOR_H
+
+#include <sdbox.h>
+#include <framebuffer.h>
+#include <readback.h>
+#include <shader.h>
+
+#include <atomic>
+
+namespace sdbox {
+
+// Progressive accumulation for path tracing sketches. Every frame renders one more sample into
+// a float target that is summed into the accumulation target, whose mean is tone mapped for
+// display. The sum of squared luminance gives each pixel's variance; every CheckInterval
+// samples it is read back and reduced on the pool to the mean relative error, so rendering
+// can stop once the image converged.
+class Accumulator {
+public:
+    static constexpr int CheckInterval = 32;
+    static constexpr int TextureUnit   = 12; // After the buffer passes
+
+    // maxSamples and tolerance of 0 never stop
+    Accumulator(ThreadPool& pool, int maxSamples, float tolerance);
+
+    Accumulator(const Accumulator&)            = delete;
+    Accumulator& operator=(const Accumulator&) = delete;
+
+    // Both also start over
+    void resize(int width, int height);
+    void reset();
+
+    // Where the next sample is rendered
+    const RenderTarget& sampleTarget() const { return *sample; }
+
+    // Adds the sample rendered into sampleTarget()
+    void accumulate();
+
+    // Tone maps the mean into the bound framebuffer
+    void resolve() const;
+
+    // Hands finished error checks to the pool
+    void poll() {
+        if (stats)
+            stats->poll();
+    }
+
+    int   samples() const { return numSamples; }
+    float error() const;
+    bool  converged() const;
+
+    // Mean of every sample as a PFM, waits for the GPU
+    bool writeHDR(const fs::path& filePath) const;
+
+private:
+    void checkError(const ReadbackFrame& frame);
+
+    int   maxSamples = 0;
+    float tolerance  = 0.0f;
+    int   numSamples = 0;
+
+    std::unique_ptr<Program>      accumProg;
+    std::unique_ptr<Program>      tonemapProg;
+    std::unique_ptr<RenderTarget> sample;
+    std::unique_ptr<RenderTarget> accum;
+    std::unique_ptr<ReadbackRing> stats;
+    ThreadPool&                   pool;
+
+    // Checks in flight when reset are ignored. Results pack the check's frame id with the error.
+    int                        epoch = 0;
+    std::atomic<int>           currentEpoch{0};
+    std::atomic<std::uint64_t> lastCheck{0};
+};
+
+} // namespace sdbox
+
+#endif
\ No newline at end of file
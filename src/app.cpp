@@ -6,9 +6,21 @@ using namespace sdbox;
 using namespace std::literals;
 
 Window InitOpenGL(const WindowOpts& winOpts) {
+    const bool headless = winOpts.backend != ContextBackend::Window;
+
+    // No display server, GLFW only manages the contexts
+    if (headless)
+        glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+
     if (!glfwInit())
         FATAL("Couldn't initialize OpenGL context.");
 
+    // Window hints persist, shared contexts created later use the same API
+    if (winOpts.backend == ContextBackend::EGL)
+        glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+    else if (winOpts.backend == ContextBackend::OSMesa)
+        glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+
     // Create window and context
     Window win{winOpts};
 
@@ -39,8 +51,28 @@ Window InitOpenGL(const WindowOpts& winOpts) {
 }
 
 SdboxApp::~SdboxApp() {
+    // Pending error checks need the workers
+    accumulator.reset();
+
+    // Frames still being captured need the workers
+    captureRing.reset();
+    video.reset();
+
+    SetGlobalThreadPool(nullptr);
+
     workers->stopWorkers();
+    if (glWorkers)
+        glWorkers->stopWorkers();
+
+    res.collectGarbage([&](Task&& deleter) { deletions.push(std::move(deleter)); });
+    deletions.flush();
+    renderGraph.reset();
 
+    gpuTimer.reset();
+    pacer.reset();
+    scaledTarget.reset();
+    scaledTargets.clear();
+    offscreen.reset();
     CleanupGeometry();
 
     for (auto ctx : sharedCtxs)
@@ -50,43 +82,114 @@ SdboxApp::~SdboxApp() {
     glfwTerminate();
 }
 
-void RebuildProgram(const Resource<Shader>& sh, ResourceRegistry& reg) {
+Unique<Program> LinkProgram(
+    const std::string& name, const Shader& mainSh, const ResourceRegistry& reg,
+    const CancelToken& token = {}) {
     auto vert = reg.getResource<Shader>(Hash("simple.vert"));
     auto frag = reg.getResource<Shader>(Hash("simple.frag"));
     DCHECK(vert && frag);
 
-    auto prog = std::make_unique<Program>(sh.name);
-    prog->addShader(*(vert.value().resource));
-    prog->addShader(*(frag.value().resource));
-    prog->addShader(*sh.resource);
+    // A newer version of the shader may be published and collected meanwhile
+    auto pin = reg.pin();
 
-    if (!prog->link())
-        return;
+    auto vertSh = reg.get(vert->handle);
+    auto fragSh = reg.get(frag->handle);
+    if (!vertSh || !fragSh)
+        return nullptr;
+
+    auto prog = std::make_unique<Program>(name);
+    prog->addShader(*vertSh);
+    prog->addShader(*fragSh);
+    prog->addShader(mainSh);
+
+    if (token.cancelled() || !prog->link())
+        return nullptr;
 
-    for (int s = 0; s < 8; ++s)
+    for (int s = 0; s < RenderGraph::FirstUnit + RenderGraph::NumBuffers; ++s)
         glProgramUniform1i(prog->id(), s, s);
 
-    reg.addResource(Resource{sh.name, sh.nameHash, sh.hash, std::move(prog)});
+    return prog;
 }
 
-std::optional<Resource<Shader>> LoadShaderResource(const fs::path& path, ResourceRegistry& reg) {
-    auto shader = LoadShaderFile(path);
-    if (!shader)
-        return std::nullopt;
+Unique<Program> LinkProgram(
+    const Resource<Shader>& sh, const ResourceRegistry& reg, const CancelToken& token = {}) {
+    auto pin    = reg.pin();
+    auto mainSh = reg.get(sh.handle);
+    return mainSh ? LinkProgram(sh.name, *mainSh, reg, token) : nullptr;
+}
+
+// Rebuilds an evicted program from the main shader source it was linked with
+Unique<Program> ReloadProgram(const Resource<Program>& prog, const ResourceRegistry& reg) {
+    if (!prog.source)
+        return nullptr;
+
+    auto shader = LoadShaderFromMemory(prog.name, prog.source->data(), prog.source->size());
+    if (!shader->compile())
+        return nullptr;
 
-    const auto fileName = path.filename();
+    LOGD("[Program] Reloaded evicted {} ({:x})", prog.name, prog.hash);
+    return LinkProgram(prog.name, *shader, reg);
+}
+
+// Whether a shader changes from frame to frame with nothing else changing
+bool DependsOnTime(const std::shared_ptr<const std::string>& source) {
+    if (!source)
+        return true;
 
+    return source->find("uTime") != std::string::npos ||
+           source->find("uFrame") != std::string::npos;
+}
+
+std::string QuoteJson(std::string_view str) {
+    std::string quoted = "\"";
+    for (const char c : str) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+            quoted += c;
+        } else if (c == '\n') {
+            quoted += "\\n";
+        } else if (c == '\t') {
+            quoted += "\\t";
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            quoted += std::format("\\u{:04x}", static_cast<int>(c));
+        } else {
+            quoted += c;
+        }
+    }
+
+    return quoted + '"';
+}
+
+std::optional<Resource<Shader>> CompileShaderResource(
+    const fs::path& fileName, std::shared_ptr<const std::string> source, ResourceRegistry& reg,
+    const CancelToken& token = {}) {
     const auto nameHash = HashBytes64(fileName);
-    const auto srcHash  = HashBytes64(shader->getSource());
-    if (reg.exists<Shader>(nameHash, srcHash) || !shader->compile()) {
-        LOGD("[Shader] Leaving early... {}", srcHash);
+    const auto srcHash  = HashBytes64(*source);
+    if (token.cancelled())
         return std::nullopt;
+
+    // Compiled before, maybe by a rebuild that got superseded before linking, so hand it back
+    // and let the caller decide whether it still needs a program
+    if (reg.exists<Shader>(nameHash, srcHash)) {
+        LOGD("[Shader] Reusing compiled {}", srcHash);
+        if (auto current = reg.slot<Shader>(nameHash).get(); current && current->hash == srcHash)
+            return current;
     }
 
-    auto resource = Resource{fileName, nameHash, srcHash, std::move(shader)};
-    reg.addResource(resource);
+    auto shader = LoadShaderFromMemory(fileName, source->data(), source->size());
+    if (token.cancelled() || !shader->compile())
+        return std::nullopt;
+
+    return reg.addResource(fileName, nameHash, srcHash, std::move(shader), std::move(source));
+}
+
+std::optional<Resource<Shader>> LoadShaderResource(const fs::path& path, ResourceRegistry& reg) {
+    auto source = util::ReadTextFile(path);
+    if (!source)
+        return std::nullopt;
 
-    return resource;
+    auto shared = std::make_shared<const std::string>(std::move(*source));
+    return CompileShaderResource(path.filename(), std::move(shared), reg);
 }
 
 void SdboxApp::createDirectoryWatcher(const fs::path& folderPath) {
@@ -98,25 +201,38 @@ void SdboxApp::createDirectoryWatcher(const fs::path& folderPath) {
         std::cout << ev << '\n';
     };
 
+    // Batched, rebuilds are launched once per dispatch in processEvents()
     auto fileChanged = [&](const WatcherEvent& ev) {
-        workers->enqueue([&, ev]() {
-            if (!IsBuiltinName(ev.name))
-                return;
+        // A buffer coming back shows its program again, even if the source didn't change
+        if (const auto idx = RenderGraph::BufferIndex(ev.name); idx >= 0)
+            bufferViews[idx].version = 0;
 
-            auto shader = LoadShaderResource(dirPath / ev.name, res);
-            if (shader)
-                RebuildProgram(shader.value(), res);
-        });
+        auto path = dirPath / ev.name;
+        if (std::find(changedShaders.begin(), changedShaders.end(), path) == changedShaders.end())
+            changedShaders.push_back(std::move(path));
+    };
+
+    // Deleting a buffer file removes its pass
+    auto bufferRemoved = [&](const WatcherEvent& ev) {
+        const auto idx = RenderGraph::BufferIndex(ev.name);
+        if (idx < 0)
+            return;
+
+        renderGraph->setPass(idx, 0, 0);
+        animatedPasses &= ~(1u << idx);
+        mousePasses &= ~(1u << idx);
+        redraw = true;
     };
 
     watcher = CreateDirectoryWatcher(folderPath);
 
     using enum EventType;
-    watcher->registerCallback(FileCreated, watcherCallback);
-    watcher->registerCallback(FileMoved, watcherCallback);
-    watcher->registerCallback(FileDeleted, watcherCallback);
-    watcher->registerCallback(FileChanged, fileChanged);
+    watcher->subscribe({"*"}, FileCreated | FileMoved | FileDeleted, watcherCallback);
+    watcher->subscribe(
+        {"main.glsl", "buffer?.glsl"}, FileChanged | FileCreated | FileMoved, fileChanged);
+    watcher->subscribe({"buffer?.glsl"}, ToMask(FileDeleted), bufferRemoved);
     watcher->registerErrorCallback(errorCallback);
+    watcher->registerNotifyCallback(WakeEventLoop);
     watcher->init();
 
     std::thread watcherThread{[&]() {
@@ -126,12 +242,96 @@ void SdboxApp::createDirectoryWatcher(const fs::path& folderPath) {
     watcherThread.detach();
 }
 
+Async<> SdboxApp::rebuildShaders(std::vector<ShaderRebuild> rebuilds) {
+    TaskGraph graph{*workers, *glWorkers};
+
+    // Files are read on the CPU workers and compiled in parallel on the GL ones
+    std::vector<TaskGraph::NodeId> compiled;
+    for (auto& rb : rebuilds) {
+        auto read = graph.add([this, &rb]() {
+            auto source = util::ReadTextFile(rb.path);
+            if (!source || rb.token.cancelled())
+                return;
+
+            // What is on screen was already linked from this source
+            auto text = std::make_shared<const std::string>(std::move(*source));
+            if (!res.exists<Program>(HashBytes64(rb.path.filename()), HashBytes64(*text)))
+                rb.source = std::move(text);
+        });
+
+        auto compile = [this, &rb]() {
+            if (rb.source)
+                rb.shader = CompileShaderResource(rb.path.filename(), rb.source, res, rb.token);
+        };
+        compiled.push_back(graph.add(compile, {read}, Affinity::GLContext));
+    }
+
+    // Every new program links once all compiles are done, behind a single fence
+    auto link = [this, &rebuilds]() -> GLsync {
+        bool linkedAny = false;
+        for (auto& rb : rebuilds) {
+            if (rb.shader && !rb.token.cancelled())
+                rb.prog = LinkProgram(*rb.shader, res, rb.token);
+            linkedAny = linkedAny || rb.prog;
+        }
+
+        // The links happened on another context, make them visible before the main one uses them
+        return linkedAny ? InsertFence() : nullptr;
+    };
+
+    auto linked = graph.add(link, compiled, Affinity::GLContext);
+    co_await graph.runAsync();
+
+    const auto fence = graph.get(linked).value_or(nullptr);
+    if (!fence)
+        co_return;
+
+    // Resumes on the main thread, from processEvents()
+    co_await fences.wait(fence);
+
+    // A newer version of a file is on its way, don't publish this one
+    for (auto& rb : rebuilds) {
+        if (!rb.prog || rb.token.cancelled())
+            continue;
+
+        const auto& sh = *rb.shader;
+        res.addResource(sh.name, sh.nameHash, sh.hash, std::move(rb.prog), sh.source);
+        redraw = true;
+    }
+}
+
+void SdboxApp::processEvents() {
+    watcher->dispatchEvents();
+    fences.poll();
+
+    // Replaced programs and shaders go away once the frames that used them are done
+    deletions.collect();
+    res.collectGarbage([&](Task&& deleter) { deletions.push(std::move(deleter)); });
+
+    if (changedShaders.empty())
+        return;
+
+    // GL workers are created on the main thread, before any graph needs them
+    glPool();
+
+    // Files changed together rebuild together, saving one again supersedes its rebuild in flight
+    std::vector<ShaderRebuild> rebuilds;
+    for (auto& path : changedShaders) {
+        auto token = workers->supersede(HashBytes64(path.filename().string()));
+        rebuilds.push_back({.path = std::move(path), .token = token});
+    }
+    changedShaders.clear();
+
+    Spawn(rebuildShaders(std::move(rebuilds)));
+}
+
 void SdboxApp::createUniforms() {
     using enum BufferFlag;
 
-    // Triple slot ring buffer
-    auto uboSize = AlignUniformBuffer(sizeof(MainUniformBlock));
-    uniformBuffer.create(BufferType::Uniform, 3, uboSize, Write | Persistent | Coherent);
+    // One slot per frame in flight
+    const auto slots   = static_cast<unsigned int>(opts.pacing.framesInFlight);
+    auto       uboSize = AlignUniformBuffer(sizeof(MainUniformBlock));
+    uniformBuffer.create(BufferType::Uniform, slots, uboSize, Write | Persistent | Coherent);
 
     uniformBuffer.registerBind(0, 0, uboSize);
 
@@ -139,11 +339,33 @@ void SdboxApp::createUniforms() {
 }
 
 void SdboxApp::createThreadPool() {
-    // Create thread pool and share OGL context
-    workers = std::make_unique<ThreadPool>(NumWorkers, [&](std::size_t idx) {
+    // CPU only workers, no OGL context
+    const std::size_t numWorkers = opts.numWorkers > 0 ? opts.numWorkers : DefaultNumThreads();
+    workers = std::make_unique<ThreadPool>(numWorkers, [](std::size_t idx) {
         SetThreadName(std::format("threadpool#{}", idx));
+    });
+
+    SetGlobalThreadPool(workers.get());
+}
+
+ThreadPool& SdboxApp::glPool() {
+    if (glWorkers)
+        return *glWorkers;
+
+    // Contexts must be created on the main thread, so this is too
+    sharedCtxs.resize(std::max(opts.numGLWorkers, 1));
+    for (auto& ctx : sharedCtxs) {
+        ctx = CreateContext({.share = win.context()});
+        if (!ctx)
+            FATAL("Failed to create shared OpenGL context.");
+    }
+
+    glWorkers = std::make_unique<ThreadPool>(sharedCtxs.size(), [&](std::size_t idx) {
+        SetThreadName(std::format("glpool#{}", idx));
         glfwMakeContextCurrent(sharedCtxs[idx]);
     });
+
+    return *glWorkers;
 }
 
 void SdboxApp::loadBaseShaders(const fs::path& folderPath) {
@@ -156,29 +378,122 @@ void SdboxApp::loadBaseShaders(const fs::path& folderPath) {
     if (!main)
         FATAL("Make sure there is a valid main.glsl file on the specified folder.");
 
-    RebuildProgram(*main, res);
+    auto prog = LinkProgram(*main, res);
+    if (!prog)
+        FATAL("Failed to link the initial program.");
+
+    res.addResource(main->name, main->nameHash, main->hash, std::move(prog), main->source);
+
+    // Buffer passes are optional
+    for (auto file : RenderGraph::BufferFiles) {
+        if (!fs::exists(folderPath / file))
+            continue;
+
+        auto buffer  = LoadShaderResource(folderPath / file, res);
+        auto bufProg = buffer ? LinkProgram(*buffer, res) : nullptr;
+        if (bufProg)
+            res.addResource(
+                buffer->name, buffer->nameHash, buffer->hash, std::move(bufProg), buffer->source);
+    }
+
+    for (int b = 0; b < RenderGraph::NumBuffers; ++b)
+        bufferViews[b].slot = &res.slot<Program>(HashBytes64(RenderGraph::BufferFiles[b]));
+
+    mainSlot = &res.slot<Program>(Hash("main.glsl"));
 }
 
-void SdboxApp::init(const fs::path& folderPath) {
+void SdboxApp::init(const fs::path& folderPath, const AppOpts& appOpts) {
     SetThreadName("main");
     InitLogger();
 
     dirPath = folderPath;
+    opts    = appOpts;
 
-    win = InitOpenGL({.width = 800, .height = 600, .visible = true});
+    const bool headless = opts.backend != ContextBackend::Window;
 
-    // Create shared contexts for threads
-    for (auto& ctx : sharedCtxs) {
-        ctx = CreateContext({.share = win.context()});
-        if (!ctx)
-            FATAL("Failed to create shared OpenGL context.");
-    }
+    win = InitOpenGL(
+        {.width   = opts.width,
+         .height  = opts.height,
+         .visible = !headless,
+         .backend = opts.backend});
+
+    // Surfaceless contexts have no default framebuffer, benchmarks keep the same size
+    if (headless || opts.benchmark.enabled())
+        createOffscreen(opts.width, opts.height);
 
     setWinCallbacks();
+
+    // An idle main thread has to come and poll the fences rebuilds wait on
+    fences.setNotify(WakeEventLoop);
     createDirectoryWatcher(folderPath);
     createThreadPool();
     createUniforms();
+
+    const auto& [w, h] = renderSize();
+    renderGraph        = std::make_unique<RenderGraph>();
+    renderGraph->resize(w, h);
+
+    // Previous programs past the budget are dropped and relinked if switched back to
+    res.setMemoryBudget(opts.memoryBudget);
+    res.setReloader<Program>([this](const Resource<Program>& prog) {
+        return ReloadProgram(prog, res);
+    });
+
     loadBaseShaders(folderPath);
+
+    if (opts.accumulate.enabled) {
+        const auto& acc    = opts.accumulate;
+        const auto& [w, h] = renderSize();
+        accumulator = std::make_unique<Accumulator>(*workers, acc.maxSamples, acc.tolerance);
+        accumulator->resize(w, h);
+    }
+
+    // One more frame of queries than frames in flight, so measuring rarely skips a frame
+    gpuTimer = std::make_unique<GpuTimer>(opts.pacing.framesInFlight + 1);
+
+    if (!headless) {
+        const auto& pacing = opts.pacing;
+        pacer = std::make_unique<FramePacer>(pacing.vsync, pacing.fpsLimit, pacing.lowLatency);
+    }
+
+    // Fixed size outputs and stills don't scale, most create their target only later
+    const bool fixedSize = headless || opts.offline.enabled() || opts.tiled.enabled() ||
+                           opts.capture.enabled() || opts.benchmark.enabled();
+    if (opts.targetMs > 0.0 && !fixedSize && !accumulator) {
+        scaler = std::make_unique<ResolutionScaler>(opts.targetMs, opts.minScale);
+        resizeScaled();
+    }
+
+    // Offline rendering sets up its own readback
+    if (opts.capture.enabled() && !opts.offline.enabled() && !opts.tiled.enabled() &&
+        !opts.benchmark.enabled())
+        startCapture();
+}
+
+void SdboxApp::createOffscreen(int w, int h) {
+    offscreen = std::make_unique<RenderTarget>(
+        ImageFormat{.pFmt = PixelFormat::U8, .width = w, .height = h, .nChannels = 4});
+}
+
+void SdboxApp::startCapture() {
+    // Captured frames are read back from the offscreen target, shown scaled in the window
+    if (!offscreen) {
+        const auto& [w, h] = win.getDimensions();
+        createOffscreen(w, h);
+    }
+
+    const auto& fmt     = offscreen->format();
+    const auto& capture = opts.capture;
+
+    video = std::make_unique<VideoWriter>(
+        capture.target, capture.format, fmt.width, fmt.height, opts.offline.frameRate);
+    if (!video->isOpen())
+        FATAL("Couldn't start capturing to {}.", capture.target);
+
+    // Conversion and writing happen on the workers, straight from the readback buffers
+    captureRing = std::make_unique<ReadbackRing>(
+        fmt, opts.offline.readbackDepth, *workers,
+        [this](const ReadbackFrame& frame) { video->write(frame.frame, frame.pixels); });
 }
 
 void SdboxApp::setWinCallbacks() {
@@ -208,51 +523,648 @@ void SdboxApp::setWinCallbacks() {
 void SdboxApp::setUniforms() {
     auto ub = uniformBuffer.get<MainUniformBlock>();
 
-    const auto& [w, h] = win.getDimensions();
-    const auto& mouse  = win.getMouse();
+    const auto& [w, h]       = renderSize();
+    const auto& [winW, winH] = win.getDimensions();
+    const auto& mouse        = win.getMouse();
 
     const auto& [left, right, mid] = mouse.buttons;
 
+    // Mouse is in window pixels, shaders expect the pixels rendered to
+    const float sx = winW > 0 ? static_cast<float>(w) / static_cast<float>(winW) : 1.0f;
+    const float sy = winH > 0 ? static_cast<float>(h) / static_cast<float>(winH) : 1.0f;
+
     ub->uResolution = {w, h, 0};
-    ub->uMouse      = {mouse.x, mouse.y, left, right};
+    ub->uTile       = {0, 0, w, h};
+    ub->uMouse      = {mouse.x * sx, mouse.y * sy, left, right};
     ub->uTime       = time;
     ub->uTimeDelta  = deltaTime;
     ub->uFrameRate  = fps;
     ub->uFrame      = frameNum;
+    ub->uSample     = accumulator ? accumulator->samples() : frameNum;
+
+    if (currentTile) {
+        ub->uResolution = {opts.tiled.width, opts.tiled.height, 0};
+        ub->uTile       = *currentTile;
+    }
+}
+
+// Whether a shader's output follows the mouse
+bool DependsOnMouse(const std::shared_ptr<const std::string>& source) {
+    return !source || source->find("uMouse") != std::string::npos;
 }
 
 void SdboxApp::setProgram() {
-    auto prog = res.getResource<Program>(Hash("main.glsl"));
-    if (prog && prog->hash != mainProg.hash) {
-        mainProg = prog.value();
-        glUseProgram(mainProg.resource->id());
+    // No locking unless a new version was published
+    const auto prevHash = mainProg.hash;
+    if (!mainSlot->fetch(mainVersion, mainProg))
+        return;
+
+    mainProgId   = res.get(mainProg.handle)->id();
+    mainAnimated = DependsOnTime(mainProg.source);
+    mainMouse    = DependsOnMouse(mainProg.source);
+
+    if (accumulator)
+        accumulator->reset();
+
+    // Switching back and forth between known programs keeps the clock running
+    if (mainProg.hash != prevHash && !progFrameTimes.contains(mainProg.hash))
         resetTime();
+}
+
+void SdboxApp::setPasses() {
+    for (int b = 0; b < RenderGraph::NumBuffers; ++b) {
+        auto& view = bufferViews[b];
+        if (!view.slot->fetch(view.version, view.prog))
+            continue;
+
+        const auto prog  = res.get(view.prog.handle);
+        const auto reads = view.prog.source ? RenderGraph::ReadsMask(*view.prog.source) : 0;
+        renderGraph->setPass(b, prog ? prog->id() : 0, reads);
+
+        if (prog && DependsOnTime(view.prog.source))
+            animatedPasses |= 1u << b;
+        else
+            animatedPasses &= ~(1u << b);
+
+        if (prog && DependsOnMouse(view.prog.source))
+            mousePasses |= 1u << b;
+        else
+            mousePasses &= ~(1u << b);
+
+        if (accumulator)
+            accumulator->reset();
+    }
+}
+
+void SdboxApp::flipProgram() {
+    const auto previous = mainSlot->previous();
+    if (previous.empty()) {
+        LOGI("No previous program to switch to.");
+        return;
+    }
+
+    // Evicted versions are relinked off the main thread, the switch happens once that's done
+    if (!previous.front().handle) {
+        Spawn(restoreAndFlip(previous.front()));
+        return;
+    }
+
+    res.flip<Program>(Hash("main.glsl"));
+}
+
+Async<> SdboxApp::restoreAndFlip(Resource<Program> version) {
+    struct Reloaded {
+        Unique<Program> prog;
+        GLsync          fence;
+    };
+
+    auto reloaded = co_await RunOn(glPool(), [this, &version]() -> std::optional<Reloaded> {
+        auto prog = res.reload(version);
+        if (!prog)
+            return std::nullopt;
+
+        return Reloaded{std::move(prog), InsertFence()};
+    });
+
+    if (!reloaded) {
+        LOG_ERROR("Couldn't reload the previous program.");
+        co_return;
     }
+
+    // Resumes on the main thread, from processEvents()
+    co_await fences.wait(reloaded->fence);
+
+    // A rebuild may have published meanwhile, switch to this version rather than the previous
+    if (res.restore(version, std::move(reloaded->prog)))
+        res.select<Program>(version.nameHash, version.hash);
+}
+
+void SdboxApp::updateFrameTimes() {
+    constexpr double ReadoutInterval = 0.5;
+
+    const double frameMs   = deltaTime * 1e3;
+    auto&        frameTime = progFrameTimes[mainProg.hash];
+    frameTime              = frameTime == 0.0 ? frameMs : 0.95 * frameTime + 0.05 * frameMs;
+
+    if (time - lastReadout < ReadoutInterval && time >= lastReadout)
+        return;
+
+    lastReadout = time;
+
+    // Current program first, then the one 'B' switches to
+    auto title = std::format(
+        "sdbox | {:.1f} MiB | {:06x} {:.2f} ms", res.memoryUsage() / double(1 << 20),
+        mainProg.hash & 0xffffff, frameTime);
+
+    if (const auto gpu = gpuTimer->stats(GpuTimer::FrameScope))
+        title += std::format(" | gpu {:.2f} ms", gpu->avg);
+
+    if (scaler)
+        title += std::format(" | {:.0f}% res", scaler->scale() * 100.0);
+
+    if (const auto latency = pacer ? pacer->latency() : std::nullopt)
+        title += std::format(" | latency {:.1f} ms", latency->avg);
+
+    const auto previous = mainSlot->previous();
+    if (!previous.empty()) {
+        auto prevTime = progFrameTimes.find(previous.front().hash);
+        if (prevTime != progFrameTimes.end())
+            title += std::format(
+                " | {:06x} {:.2f} ms", previous.front().hash & 0xffffff, prevTime->second);
+    }
+
+    win.setTitle(title);
 }
 
 void SdboxApp::render() {
     uniformBuffer.wait();
     uniformBuffer.rebind();
 
+    // Results of earlier frames. After the wait the oldest frame in flight is done, so the timer
+    // always has a free set of queries for this one.
+    if (const auto gpuMs = gpuTimer->poll(); gpuMs && scaler)
+        updateResolution(*gpuMs);
+
+    gpuTimer->beginFrame();
+
     setProgram();
+    setPasses();
     setUniforms();
 
+    renderGraph->execute(gpuTimer.get());
+
+    if (accumulator) {
+        // Moving the mouse changes what is being averaged, if anything reads it. Otherwise only
+        // dragging does, for whatever the sketch does with clicks.
+        const auto& mouse              = win.getMouse();
+        const auto& [left, right, mid] = mouse.buttons;
+
+        const bool      held       = left != KeyState::Released || right != KeyState::Released;
+        const bool      readsMouse = mainMouse || mousePasses != 0;
+        const glm::vec4 mouseState = {mouse.x, mouse.y, left, right};
+        if (mouseState != lastMouse && (readsMouse || held))
+            accumulator->reset();
+        lastMouse = mouseState;
+
+        // Converged images are only shown
+        if (!accumulator->converged()) {
+            gpuTimer->begin("main");
+            accumulator->sampleTarget().bind();
+            drawMain();
+            gpuTimer->end();
+
+            gpuTimer->begin("accumulate");
+            accumulator->accumulate();
+            gpuTimer->end();
+        }
+
+        gpuTimer->begin("resolve");
+        bindOutput();
+        accumulator->resolve();
+        gpuTimer->end();
+    } else {
+        gpuTimer->begin("main");
+        bindOutput();
+        drawMain();
+        gpuTimer->end();
+    }
+
+    gpuTimer->begin("present");
+    present();
+    gpuTimer->end();
+
+    gpuTimer->endFrame();
+
+    uniformBuffer.lockAndSwap();
+    deletions.endFrame();
+}
+
+void SdboxApp::drawMain() const {
+    glUseProgram(mainProgId);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     RenderQuad();
+}
 
-    uniformBuffer.lockAndSwap();
+void SdboxApp::bindOutput() const {
+    if (const auto target = offscreen ? offscreen.get() : scaledTarget.get()) {
+        target->bind();
+        return;
+    }
+
+    const auto& [w, h] = win.getDimensions();
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, w, h);
+}
+
+void SdboxApp::present() const {
+    // Headless targets have no window to show them in
+    if (opts.backend != ContextBackend::Window)
+        return;
+
+    const auto target = offscreen ? offscreen.get() : scaledTarget.get();
+    if (!target)
+        return;
+
+    const auto& fmt    = target->format();
+    const auto& [w, h] = win.getDimensions();
+    glBlitNamedFramebuffer(
+        target->id(), 0, 0, 0, fmt.width, fmt.height, 0, 0, w, h, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+}
+
+void SdboxApp::resizeScaled() {
+    // A few recent sizes stay pooled, the scaler tends to go back and forth between them
+    constexpr std::size_t KeptTargets = 2;
+
+    const auto& [winW, winH] = win.getDimensions();
+    const auto& [w, h]       = scaler->apply(winW, winH);
+
+    if (scaledTarget)
+        scaledTargets.release(std::move(scaledTarget));
+    scaledTargets.trim(KeptTargets);
+
+    scaledTarget = scaledTargets.acquire(
+        ImageFormat{.pFmt = PixelFormat::U8, .width = w, .height = h, .nChannels = 4});
+    renderGraph->resize(w, h);
+}
+
+void SdboxApp::updateResolution(double gpuMs) {
+    // The main image goes to a fixed size target, scaling the passes would only break them
+    if (offscreen || !scaler->update(gpuMs))
+        return;
+
+    resizeScaled();
+    LOGD("Render scale {:.0f}% at {:.2f} ms.", scaler->scale() * 100.0, scaler->frameTime());
+}
+
+void SdboxApp::reportGpuTimes() const {
+    if (gpuTimer->stats().empty())
+        return;
+
+    LOGI("{}", gpuTimer->summary());
+
+    if (!opts.gpuStats.empty() && util::WriteTextFile(opts.gpuStats, gpuTimer->json()))
+        LOGI("Wrote GPU times to {}.", opts.gpuStats.string());
+}
+
+bool SdboxApp::animated() const {
+    if (accumulator)
+        return !accumulator->converged();
+
+    return mainAnimated || animatedPasses != 0 || renderGraph->feedback();
+}
+
+bool SdboxApp::idle() const {
+    // Outputs that are written out need every frame
+    if (redraw || offscreen || opts.backend != ContextBackend::Window)
+        return false;
+
+    return paused || (opts.onDemand && !animated());
+}
+
+void SdboxApp::waitEvents() {
+    // Shader rebuilds finish behind fences, they can't post an event once the GPU is done
+    constexpr double FencePollInterval = 0.002;
+
+    if (fences.size() > 0)
+        win.waitEvents(FencePollInterval);
+    else
+        win.waitEvents();
+}
+
+void SdboxApp::updateAccumulation() {
+    accumulator->poll();
+
+    // The count stays put while paused or converged, no need to set the same title again
+    const int samples = accumulator->samples();
+    if (samples != titleSamples && samples % Accumulator::CheckInterval == 0) {
+        win.setTitle(
+            std::format("sdbox | {} samples | error {:.4f}", samples, accumulator->error()));
+        titleSamples = samples;
+    }
+
+    if (!accumulator->converged() || hdrWritten)
+        return;
+
+    const auto& output = opts.accumulate.hdrOutput;
+    if (accumulator->writeHDR(output))
+        LOGI("Converged after {} samples, wrote {}.", accumulator->samples(), output.string());
+
+    hdrWritten = true;
 }
 
 void SdboxApp::loop() {
+    if (opts.benchmark.enabled()) {
+        renderBenchmark();
+        return;
+    }
+
+    if (opts.tiled.enabled()) {
+        renderTiled();
+        reportGpuTimes();
+        return;
+    }
+
+    if (opts.offline.enabled()) {
+        renderOffline();
+        reportGpuTimes();
+        return;
+    }
+
     glfwSetTime(0.0);
 
-    while (!glfwWindowShouldClose(win.context())) {
+    for (int frame = 0; !glfwWindowShouldClose(win.context());) {
+        if (opts.maxFrames > 0 && frame >= opts.maxFrames)
+            break;
+
+        processEvents();
+
+        // The last frame is still what should be shown, sleep until something changes
+        if (idle()) {
+            waitEvents();
+            pacer->inputSampled();
+            continue;
+        }
+
         render();
+        redraw = false;
+        ++frame;
+
+        if (captureRing) {
+            captureRing->read(*offscreen, capturedFrames++);
+            captureRing->poll();
+        }
+
+        // Accumulated images are stills
+        if (accumulator) {
+            updateAccumulation();
 
-        if (!paused)
+            // Nothing left to do without a window
+            if (hdrWritten && opts.backend != ContextBackend::Window)
+                break;
+        } else if (!paused) {
             updateTime();
+            updateFrameTimes();
+        }
+
+        // Input is sampled as late as possible, after waiting on the limit and the GPU
+        if (pacer) {
+            win.swapBuffers();
+            pacer->frameSubmitted();
+            pacer->limit();
+            pacer->sampleInput();
+        }
 
-        win.swapBuffers();
         win.pollEvents();
+        if (pacer)
+            pacer->inputSampled();
     }
+
+    // Closed before converging, keep what there is
+    if (accumulator && !hdrWritten && accumulator->samples() > 0)
+        accumulator->writeHDR(opts.accumulate.hdrOutput);
+
+    reportGpuTimes();
+
+    if (const auto latency = pacer ? pacer->latency() : std::nullopt)
+        LOGI(
+            "Input to photon estimate: avg {:.2f} ms, p99 {:.2f} ms, max {:.2f} ms.", latency->avg,
+            latency->p99, latency->max);
+}
+
+void SdboxApp::renderOffline() {
+    using Clock = std::chrono::steady_clock;
+
+    const auto& offline = opts.offline;
+
+    // Frames are read back from an offscreen target, with or without a window
+    if (!offscreen) {
+        const auto& [w, h] = win.getDimensions();
+        createOffscreen(w, h);
+    }
+
+    const auto& fmt = offscreen->format();
+
+    // Encoders run on the workers, straight from the mapped readback buffers
+    ReadbackRing::ConsumeFunc encode;
+    if (opts.capture.enabled()) {
+        video = std::make_unique<VideoWriter>(
+            opts.capture.target, opts.capture.format, fmt.width, fmt.height, offline.frameRate,
+            offline.firstFrame);
+        if (!video->isOpen())
+            FATAL("Couldn't start capturing to {}.", opts.capture.target);
+
+        encode = [this](const ReadbackFrame& frame) { video->write(frame.frame, frame.pixels); };
+    } else {
+        std::error_code ec;
+        fs::create_directories(offline.outputDir, ec);
+        if (ec)
+            FATAL("Couldn't create output folder {}. {}", offline.outputDir.string(), ec.message());
+
+        encode = [&dir = offline.outputDir](const ReadbackFrame& frame) {
+            const auto path = dir / std::format("frame{:05}.ppm", frame.frame);
+            WritePPM(path, frame.format, frame.pixels);
+        };
+    }
+
+    ReadbackRing readback{fmt, offline.readbackDepth, *workers, std::move(encode)};
+
+    // Time only depends on the frame number, shader edits are ignored until done
+    setProgram();
+    deltaTime = 1.0 / offline.frameRate;
+    fps       = offline.frameRate;
+
+    const auto start = Clock::now();
+
+    int numFrames = 0;
+    for (int f = offline.firstFrame; f <= offline.lastFrame; ++f, ++numFrames) {
+        if (glfwWindowShouldClose(win.context()))
+            break;
+
+        deletions.collect();
+
+        frameNum = f;
+        time     = f * deltaTime;
+        render();
+
+        readback.read(*offscreen, f);
+        readback.poll();
+
+        win.pollEvents();
+    }
+
+    readback.finish();
+
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    LOGI("Rendered {} frames in {:.2f} s, {:.1f} fps.", numFrames, seconds, numFrames / seconds);
+}
+
+void SdboxApp::renderBenchmark() {
+    using Clock = std::chrono::steady_clock;
+
+    const auto& bench   = opts.benchmark;
+    const bool  gpuTime = GpuTimer::Supported();
+
+    // Every measured frame is kept
+    gpuTimer = std::make_unique<GpuTimer>(opts.pacing.framesInFlight + 1, bench.frames);
+
+    std::vector<double> cpuTimes;
+    cpuTimes.reserve(bench.frames);
+
+    // Time only depends on the frame number, shader edits are ignored until done
+    setProgram();
+    deltaTime = 1.0 / opts.offline.frameRate;
+    fps       = opts.offline.frameRate;
+
+    for (int f = 0; f < bench.warmup + bench.frames; ++f) {
+        if (glfwWindowShouldClose(win.context()))
+            break;
+
+        // Compiling and caching in the driver happens during warmup, it doesn't count
+        if (f == bench.warmup) {
+            gpuTimer->finish();
+            gpuTimer->reset();
+        }
+
+        deletions.collect();
+
+        frameNum = f;
+        time     = f * deltaTime;
+
+        const auto start = Clock::now();
+        render();
+
+        // Without timestamps every frame is waited for, so CPU time covers the GPU's work too
+        if (!gpuTime) {
+            glFinish();
+            if (f >= bench.warmup)
+                cpuTimes.push_back(
+                    std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+        }
+
+        win.pollEvents();
+    }
+
+    gpuTimer->finish();
+
+    const auto frame = gpuTime ? gpuTimer->stats(GpuTimer::FrameScope).value_or(TimingStats{})
+                               : SummarizeTimes(cpuTimes);
+
+    LOGI(
+        "Benchmark over {} frames ({} time): mean {:.3f} ms, median {:.3f} ms, p95 {:.3f} ms, "
+        "p99 {:.3f} ms, max {:.3f} ms.",
+        frame.count, gpuTime ? "GPU" : "CPU", frame.avg, frame.p50, frame.p95, frame.p99,
+        frame.max);
+
+    if (frame.count != static_cast<std::size_t>(bench.frames))
+        LOGW("Only {} of {} frames were measured.", frame.count, bench.frames);
+
+    auto glString = [](GLenum name) {
+        const auto str = reinterpret_cast<const char*>(glGetString(name));
+        return QuoteJson(str ? str : "");
+    };
+
+    const auto& [w, h] = renderSize();
+    const auto json    = std::format(
+        "{{\n  \"sketch\": {},\n  \"renderer\": {},\n  \"version\": {},\n"
+        "  \"width\": {},\n  \"height\": {},\n  \"warmup\": {},\n  \"timeStep\": {},\n"
+        "  \"timer\": \"{}\",\n  \"frame\": {},\n  \"passes\": {}\n}}\n",
+        QuoteJson(dirPath.string()), glString(GL_RENDERER), glString(GL_VERSION), w, h,
+        bench.warmup, deltaTime, gpuTime ? "gpu" : "cpu", ToJson(frame),
+        gpuTime ? gpuTimer->json() : "{}");
+
+    if (util::WriteTextFile(bench.output, json))
+        LOGI("Wrote benchmark results to {}.", bench.output.string());
+}
+
+void SdboxApp::renderTiled() {
+    using Clock = std::chrono::steady_clock;
+
+    const auto& tiled = opts.tiled;
+
+    // A buffer pass rendered per tile only sees that tile, neighbours and history are wrong
+    setPasses();
+    if (!renderGraph->empty())
+        FATAL("Tiled rendering doesn't support buffer passes, use --offline instead.");
+
+    // Tiles stay within every limit on a single render
+    GLint maxViewport[2] = {};
+    GLint maxTexture = 0, maxFbWidth = 0, maxFbHeight = 0;
+    glGetIntegerv(GL_MAX_VIEWPORT_DIMS, maxViewport);
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTexture);
+    glGetIntegerv(GL_MAX_FRAMEBUFFER_WIDTH, &maxFbWidth);
+    glGetIntegerv(GL_MAX_FRAMEBUFFER_HEIGHT, &maxFbHeight);
+
+    const int tileSize = std::min(
+        {tiled.tileSize, std::max(tiled.width, tiled.height), maxViewport[0], maxViewport[1],
+         maxTexture, maxFbWidth, maxFbHeight});
+
+    const int tilesX = (tiled.width + tileSize - 1) / tileSize;
+    const int tilesY = (tiled.height + tileSize - 1) / tileSize;
+
+    // Stitched straight into the mapped file, the image is never whole in memory
+    const auto header   = std::format("P6\n{} {}\n255\n", tiled.width, tiled.height);
+    const auto rowBytes = static_cast<std::size_t>(tiled.width) * 3;
+
+    util::MappedFile file{tiled.output, header.size() + rowBytes * tiled.height};
+    if (!file.isOpen())
+        FATAL("Couldn't create {}.", tiled.output.string());
+
+    std::memcpy(file.data(), header.data(), header.size());
+    std::byte* const pixels = file.data() + header.size();
+
+    createOffscreen(tileSize, tileSize);
+    renderGraph->resize(tileSize, tileSize);
+
+    // A band of tiles is dropped from memory once its last tile is stitched
+    std::vector<std::atomic<int>> bandTiles(tilesY);
+    for (auto& count : bandTiles)
+        count.store(tilesX, std::memory_order_relaxed);
+
+    auto stitch = [&](const ReadbackFrame& tile) {
+        const int ox = (tile.frame % tilesX) * tileSize;
+        const int oy = (tile.frame / tilesX) * tileSize;
+        const int tw = std::min(tileSize, tiled.width - ox);
+        const int th = std::min(tileSize, tiled.height - oy);
+
+        // Tiles and GL rows go bottom up, the file top down
+        for (int y = 0; y < th; ++y) {
+            const auto src = tile.pixels + static_cast<std::size_t>(y) * tileSize * 4;
+            auto       dst = pixels + (tiled.height - 1 - oy - y) * rowBytes + ox * 3;
+            for (int x = 0; x < tw; ++x)
+                std::memcpy(dst + x * 3, src + x * 4, 3);
+        }
+
+        if (bandTiles[oy / tileSize].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            const auto firstRow = static_cast<std::size_t>(tiled.height - oy - th);
+            file.release(header.size() + firstRow * rowBytes, th * rowBytes);
+        }
+    };
+
+    ReadbackRing readback{offscreen->format(), opts.offline.readbackDepth, *workers, stitch};
+
+    setProgram();
+
+    const auto start = Clock::now();
+
+    for (int t = 0; t < tilesX * tilesY; ++t) {
+        deletions.collect();
+
+        const auto x = static_cast<float>((t % tilesX) * tileSize);
+        const auto y = static_cast<float>((t / tilesX) * tileSize);
+        currentTile  = glm::vec4{x, y, tileSize, tileSize};
+        render();
+
+        readback.read(*offscreen, t);
+        readback.poll();
+
+        win.pollEvents();
+    }
+
+    readback.finish();
+    currentTile.reset();
+
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    LOGI(
+        "Rendered {}x{} in {} tiles of {}px to {} in {:.2f} s.", tiled.width, tiled.height,
+        tilesX * tilesY, tileSize, tiled.output.string(), seconds);
 }
\ No newline at end of file
@@ -15,10 +15,21 @@
 #include <glm/vec4.hpp>
 
 #include <ringbuffer.h>
+#include <rendergraph.h>
 #include <thread.h>
+#include <async.h>
+#include <fence.h>
+#include <framebuffer.h>
+#include <readback.h>
+#include <accumulator.h>
+#include <gputimer.h>
+#include <resolutionscaler.h>
+#include <framepacer.h>
+#include <taskgraph.h>
 #include <win.h>
 #include <watcher/watcher.h>
 #include <util.h>
+#include <video.h>
 
 #include <unordered_set>
 
@@ -30,26 +41,132 @@ namespace sdbox {
 
 struct MainUniformBlock {
     glm::vec4 uMouse;      // xy = current, zw = click
-    glm::vec3 uResolution; // Viewport res
+    glm::vec4 uTile;       // xy = pixel offset, zw = size of the rendered tile
+    glm::vec3 uResolution; // Viewport res, whole image when tiled
     float     uTime;       // Shader playback (seconds)
     float     uTimeDelta;  // Render time (seconds)
     float     uFrameRate;  // Frame rate
     int       uFrame;      // Number of the frame
+    int       uSample;     // Samples accumulated so far, the frame number when not accumulating
 };
 
-constexpr int NumWorkers = 2;
+// Renders frames first..last at a fixed time step to disk instead of running interactively
+struct OfflineOpts {
+    int      firstFrame    = 0;
+    int      lastFrame     = -1; // Inclusive, offline rendering is off when before firstFrame
+    double   frameRate     = 60.0;
+    int      readbackDepth = 3; // Frames the GPU may run ahead of the readback
+    fs::path outputDir     = "frames";
+
+    bool enabled() const { return lastFrame >= firstFrame; }
+};
+
+// Renders one image of any size in tiles into a memory mapped PPM, for outputs beyond the
+// viewport, framebuffer or memory limits
+struct TiledOpts {
+    int      width    = 0;
+    int      height   = 0;
+    int      tileSize = 2048; // Clamped to the GL limits
+    fs::path output   = "poster.ppm";
+
+    bool enabled() const { return width > 0 && height > 0; }
+};
+
+// Averages one sample per frame instead of redrawing, for path tracing sketches. Time stands
+// still and the average starts over whenever the program, the buffers or the mouse change.
+struct AccumulateOpts {
+    bool     enabled    = false;
+    int      maxSamples = 0;    // Stop after this many samples, 0 = never
+    float    tolerance  = 0.0f; // Stop once the mean relative error is below this, 0 = never
+    fs::path hdrOutput  = "accumulated.pfm";
+};
+
+// Streams rendered frames as video, also used by offline rendering instead of image files.
+// The frame rate in the header is OfflineOpts::frameRate.
+struct CaptureOpts {
+    std::string target; // File or "|command" to pipe into
+    VideoFormat format = VideoFormat::Y4M;
+
+    bool enabled() const { return !target.empty(); }
+};
+
+// Only apply to the window, headless and offline rendering go as fast as they can
+struct PacingOpts {
+    VSync  vsync          = VSync::On;
+    double fpsLimit       = 0.0;   // 0 = no limit
+    int    framesInFlight = 3;     // Uniform ring slots the CPU may run ahead by
+    bool   lowLatency     = false; // Wait for the last frame to finish before sampling input
+};
+
+// Renders warmup plus frames frames at a fixed size and time step, OfflineOpts::frameRate, and
+// writes frame time statistics as JSON
+struct BenchmarkOpts {
+    int      frames = 0;
+    int      warmup = 30;
+    fs::path output = "benchmark.json";
+
+    bool enabled() const { return frames > 0; }
+};
+
+struct AppOpts {
+    int            width        = 800;
+    int            height       = 600;
+    ContextBackend backend      = ContextBackend::Window;
+    int            maxFrames    = 0;         // Stop after this many frames, 0 = until closed
+    int            numWorkers   = 0;         // CPU only workers, 0 = hardware concurrency
+    int            numGLWorkers = 2;         // Shared context workers, created on first use
+    std::size_t    memoryBudget = 256 << 20; // Resource registry budget in bytes
+    double         targetMs     = 0.0;       // GPU frame time to hold by scaling, 0 = off
+    double         minScale     = 0.25;      // Lowest resolution scale
+    fs::path       gpuStats;                 // Per pass GPU times written here as JSON on exit
+    bool           onDemand     = false;     // Redraw only on changes while nothing animates
+    OfflineOpts    offline;
+    CaptureOpts    capture;
+    PacingOpts     pacing;
+    TiledOpts      tiled;
+    AccumulateOpts accumulate;
+    BenchmarkOpts  benchmark;
+};
 
 class SdboxApp {
 public:
     ~SdboxApp();
 
-    void init(const fs::path& folderPath);
+    void init(const fs::path& folderPath, const AppOpts& appOpts = {});
     void setUniforms();
     void render();
     void loop();
+    void renderOffline();
+    void renderTiled();
+    void renderBenchmark();
 
 private:
+    // One file of a rebuild batch, filled in as it goes through the graph
+    struct ShaderRebuild {
+        fs::path                           path;
+        CancelToken                        token;
+        std::shared_ptr<const std::string> source;
+        std::optional<Resource<Shader>>    shader;
+        Unique<Program>                    prog;
+    };
+
     void setProgram();
+    void setPasses();
+    void flipProgram();
+    void updateFrameTimes();
+    void updateAccumulation();
+    void drawMain() const;
+    void bindOutput() const;
+    void present() const;
+    void resizeScaled();
+    void updateResolution(double gpuMs);
+    void reportGpuTimes() const;
+    bool animated() const;
+    bool idle() const;
+    void waitEvents();
+    void processEvents();
+    Async<> rebuildShaders(std::vector<ShaderRebuild> rebuilds);
+    Async<> restoreAndFlip(Resource<Program> version);
 
     void resetTime() {
         time      = 0.0;
@@ -70,19 +187,53 @@ private:
     }
 
     void setWinCallbacks();
-    void reshape(int w, int h) { glViewport(0, 0, w, h); }
-    void mouseMotion(double x, double y) {}
-    void mouseClick(MouseButton btn, KeyState state) {}
+    void reshape(int w, int h) {
+        glViewport(0, 0, w, h);
+        redraw = true;
+
+        // Offscreen rendering keeps its size, the window only shows it scaled
+        if (offscreen)
+            return;
+
+        if (scaler) {
+            resizeScaled();
+            return;
+        }
+
+        renderGraph->resize(w, h);
+        if (accumulator)
+            accumulator->resize(w, h);
+    }
+    void mouseMotion(double x, double y) { redraw = true; }
+    void mouseClick(MouseButton btn, KeyState state) { redraw = true; }
     void processKeys(int key, int scancode, int action, int mods) {
+        redraw = true;
+
         if (key == 'P' && action == GLFW_RELEASE) {
             paused = !paused;
             if (!paused)
                 glfwSetTime(time);
         }
+
+        // A/B between the current and the previous program, no recompiling
+        if (key == 'B' && action == GLFW_RELEASE)
+            flipProgram();
+
+        if (key == 'G' && action == GLFW_RELEASE)
+            LOGI("{}", gpuTimer->summary());
     }
 
     void createUniforms();
+    void createOffscreen(int w, int h);
+    void startCapture();
+
+    std::tuple<int, int> renderSize() const {
+        if (const auto target = offscreen ? offscreen.get() : scaledTarget.get())
+            return {target->format().width, target->format().height};
+        return win.getDimensions();
+    }
     void createThreadPool();
+    ThreadPool& glPool();
     void createDirectoryWatcher(const fs::path& folderPath);
     void loadBaseShaders(const fs::path& folderPath);
 
@@ -93,19 +244,70 @@ private:
     double time      = 0.0;
     double deltaTime = 0.0;
     bool   paused    = false;
+    bool   redraw    = true; // Something changed since the last frame
 
-    fs::path dirPath;
+    fs::path              dirPath;
+    std::vector<fs::path> changedShaders;
 
     RingBuffer uniformBuffer{};
 
+    AppOpts opts;
+
     std::unique_ptr<ThreadPool>       workers;
+    std::unique_ptr<ThreadPool>       glWorkers;
     std::unique_ptr<DirectoryWatcher> watcher;
 
-    std::array<OpenglContext*, NumWorkers> sharedCtxs;
+    std::vector<OpenglContext*> sharedCtxs;
+    FencePoller                 fences;
+    DeletionQueue               deletions;
 
     ResourceRegistry res;
 
-    Resource<Program> mainProg;
+    const ResourceSlot<Program>* mainSlot    = nullptr;
+    std::uint64_t                mainVersion = 0;
+    Resource<Program>            mainProg;
+    unsigned int                 mainProgId   = 0;
+    bool                         mainAnimated = true; // Reads the clock or the frame number
+    bool                         mainMouse    = true; // Reads the mouse
+
+    // Render thread view of each buffer pass program
+    struct ProgramView {
+        const ResourceSlot<Program>* slot    = nullptr;
+        std::uint64_t                version = 0;
+        Resource<Program>            prog;
+    };
+
+    std::array<ProgramView, RenderGraph::NumBuffers> bufferViews;
+    std::unique_ptr<RenderGraph>                     renderGraph;
+    std::uint32_t                                    animatedPasses = 0;
+    std::uint32_t                                    mousePasses    = 0;
+
+    // Main pass output when running headless or offline
+    std::unique_ptr<RenderTarget> offscreen;
+
+    std::unique_ptr<VideoWriter>  video;
+    std::unique_ptr<ReadbackRing> captureRing;
+    int                           capturedFrames = 0;
+
+    // Tile being rendered, xy = pixel offset, zw = size
+    std::optional<glm::vec4> currentTile;
+
+    std::unique_ptr<Accumulator> accumulator;
+    glm::vec4                    lastMouse{0.0f};
+    int                          titleSamples = 0; // Sample count the title shows
+    bool                         hdrWritten   = false;
+
+    std::unique_ptr<GpuTimer>   gpuTimer;
+    std::unique_ptr<FramePacer> pacer;
+
+    // Dynamic resolution, the main image renders scaled and is upscaled to the window
+    std::unique_ptr<ResolutionScaler> scaler;
+    std::unique_ptr<RenderTarget>     scaledTarget;
+    RenderTargetPool                  scaledTargets;
+
+    // Smoothed frame time (ms) of every program that has been active
+    std::unordered_map<HashResult, double> progFrameTimes;
+    double                                 lastReadout = 0.0;
 };
 
 } // namespace sdbox
@@ -0,0 +1,126 @@
+#include <framepacer.h>
+
+#include <GLFW/glfw3.h>
+
+#include <thread>
+
+using namespace sdbox;
+using namespace std::chrono;
+
+namespace {
+// Long enough to never give up on a frame that is merely slow
+constexpr nanoseconds LowLatencyTimeout = 100ms;
+
+int SwapInterval(VSync vsync) {
+    switch (vsync) {
+    case VSync::Off:
+        return 0;
+    case VSync::On:
+        return 1;
+    case VSync::Adaptive:
+        // Late frames tear instead of waiting for the next blank
+        if (glfwExtensionSupported("GLX_EXT_swap_control_tear") ||
+            glfwExtensionSupported("WGL_EXT_swap_control_tear"))
+            return -1;
+
+        LOGW("Adaptive vsync isn't supported, using regular vsync.");
+        return 1;
+    }
+
+    return 1;
+}
+
+double RefreshInterval() {
+    const auto monitor = glfwGetPrimaryMonitor();
+    const auto mode    = monitor ? glfwGetVideoMode(monitor) : nullptr;
+    return mode && mode->refreshRate > 0 ? 1e3 / mode->refreshRate : 1e3 / 60.0;
+}
+} // namespace
+
+FramePacer::FramePacer(VSync vsync, double fpsLimit, bool lowLatency, std::size_t window)
+    : window(window), lowLatency(lowLatency) {
+    glfwSwapInterval(SwapInterval(vsync));
+
+    if (fpsLimit > 0.0)
+        period = duration_cast<Clock::duration>(duration<double>(1.0 / fpsLimit));
+
+    // Done frames wait half a refresh on average before they're scanned out
+    if (vsync != VSync::Off)
+        vblankMs = 0.5 * RefreshInterval();
+
+    latencies.reserve(window);
+    deadline  = Clock::now();
+    lastInput = deadline;
+}
+
+FramePacer::~FramePacer() {
+    for (auto& frame : pending)
+        glDeleteSync(frame.fence);
+}
+
+void FramePacer::frameSubmitted() {
+    pending.push_back({InsertFence(), lastInput});
+
+    // Done frames are only noticed here and before input, the estimate is as coarse as that
+    retireDone(0, nanoseconds::zero());
+}
+
+void FramePacer::limit() {
+    if (period == Clock::duration::zero())
+        return;
+
+    deadline += period;
+
+    // Too far behind to catch up, start counting from now
+    const auto now = Clock::now();
+    if (deadline < now) {
+        deadline = now;
+        return;
+    }
+
+    if (deadline - now > SpinMargin)
+        std::this_thread::sleep_until(deadline - SpinMargin);
+
+    while (Clock::now() < deadline)
+        std::this_thread::yield();
+}
+
+void FramePacer::sampleInput() {
+    // Frame N-1 has to finish, frame N keeps the GPU busy meanwhile
+    retireDone(lowLatency ? 1 : 0, lowLatency ? LowLatencyTimeout : nanoseconds::zero());
+}
+
+void FramePacer::inputSampled() {
+    lastInput = Clock::now();
+}
+
+std::optional<TimingStats> FramePacer::latency() const {
+    if (latencies.empty())
+        return std::nullopt;
+
+    return SummarizeTimes(latencies);
+}
+
+void FramePacer::retireDone(std::size_t keep, nanoseconds timeout) {
+    while (!pending.empty()) {
+        const auto& frame = pending.front();
+        const auto  wait  = pending.size() > keep ? timeout : nanoseconds::zero();
+        const auto  res   = glClientWaitSync(frame.fence, 0, wait.count());
+        if (res != GL_ALREADY_SIGNALED && res != GL_CONDITION_SATISFIED)
+            break;
+
+        retire(frame, Clock::now());
+        pending.pop_front();
+    }
+}
+
+void FramePacer::retire(const Pending& frame, Clock::time_point done) {
+    glDeleteSync(frame.fence);
+
+    const double ms = duration<double, std::milli>(done - frame.input).count() + vblankMs;
+    if (latencies.size() < window)
+        latencies.push_back(ms);
+    else
+        latencies[next] = ms;
+    next = (next + 1) % window;
+}
\ No newline at end of file
@@ -0,0 +1,75 @@
+#ifndef SDBOX_FRAMEPACER_H
+#define SDBOX_FRAMEPACER_H
+
+#include <sdbox.h>
+#include <fence.h>
+#include <gputimer.h>
+
+#include <chrono>
+#include <deque>
+#include <optional>
+
+namespace sdbox {
+
+enum class VSync { Off, On, Adaptive };
+
+// Paces the windowed loop: sets the swap interval, caps the frame rate and, in low latency
+// mode, waits for the GPU to finish the previous frame before input is sampled for the next
+// one, so input queues behind at most the frame just submitted. Also estimates input-to-photon
+// latency as the time from sampling input to the GPU finishing the frame that used it, plus
+// half a refresh interval of waiting for the vertical blank when synced.
+class FramePacer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Sleeping wakes up this much before the deadline, the rest is spent spinning
+    static constexpr auto SpinMargin = std::chrono::microseconds(1500);
+
+    // Needs the window's context current
+    FramePacer(VSync vsync, double fpsLimit, bool lowLatency, std::size_t window = 512);
+    ~FramePacer();
+
+    FramePacer(const FramePacer&)            = delete;
+    FramePacer& operator=(const FramePacer&) = delete;
+
+    // Right after the swap
+    void frameSubmitted();
+
+    // Sleeps, then spins until the next frame is due, before input is sampled
+    void limit();
+
+    // Right before events are polled. Low latency waits for every frame but the one just
+    // submitted, which stays in flight.
+    void sampleInput();
+
+    // Right after events were polled
+    void inputSampled();
+
+    std::optional<TimingStats> latency() const;
+
+private:
+    struct Pending {
+        GLsync            fence;
+        Clock::time_point input;
+    };
+
+    // Retires finished frames from the front, waiting up to timeout on each while more than
+    // keep frames are pending
+    void retireDone(std::size_t keep, std::chrono::nanoseconds timeout);
+    void retire(const Pending& frame, Clock::time_point done);
+
+    std::deque<Pending> pending;
+    std::vector<double> latencies; // Ring of the last window estimates
+    std::size_t         next   = 0;
+    std::size_t         window = 512;
+
+    Clock::duration   period{0}; // Frame rate limit, zero if there's none
+    Clock::time_point deadline;
+    Clock::time_point lastInput;
+    double            vblankMs   = 0.0;
+    bool              lowLatency = false;
+};
+
+} // namespace sdbox
+
+#endif
\ No newline at end of file
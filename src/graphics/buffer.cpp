@@ -5,7 +5,8 @@ using namespace std::chrono;
 using namespace std::chrono_literals;
 
 namespace {
-const GLenum OGLBufferTarget[] = {GL_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER, GL_UNIFORM_BUFFER};
+const GLenum OGLBufferTarget[] = {
+    GL_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER, GL_UNIFORM_BUFFER, GL_PIXEL_PACK_BUFFER};
 
 constexpr nanoseconds FenceTimeout = 33ms;
 }
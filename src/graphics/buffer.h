@@ -7,7 +7,7 @@
 
 namespace sdbox {
 
-enum class BufferType : unsigned int { Array = 0, Element = 1, Uniform = 2 };
+enum class BufferType : unsigned int { Array = 0, Element = 1, Uniform = 2, PixelPack = 3 };
 constexpr bool EnumHasConversion(BufferType);
 
 enum class BufferFlag : unsigned int {
@@ -38,6 +38,8 @@ public:
     void create(BufferType type, std::size_t size, BufferFlag flags, const void* data);
     void bindRange(unsigned int index, std::size_t offset, std::size_t size) const;
 
+    unsigned int id() const { return handle; }
+
     template<typename T>
     T* get(std::size_t offset = 0) const {
         DCHECK(HasFlag(flags, BufferFlag::Persistent));
@@ -0,0 +1,115 @@
+#include <fence.h>
+
+using namespace sdbox;
+
+FencePoller::~FencePoller() {
+    // Coroutines still waiting are abandoned with their fences
+    for (auto& waiter : waiters)
+        glDeleteSync(waiter.sync);
+}
+
+void FencePoller::add(GLsync sync, std::coroutine_handle<> handle) {
+    {
+        std::lock_guard lock{mutex};
+        waiters.emplace_back(sync, handle);
+    }
+
+    if (notify)
+        notify();
+}
+
+std::size_t FencePoller::poll() {
+    {
+        std::lock_guard lock{mutex};
+        polling.swap(waiters);
+    }
+
+    if (polling.empty())
+        return 0;
+
+    std::size_t numSignaled = 0;
+
+    std::vector<Waiter> pending;
+    for (auto& waiter : polling) {
+        const GLenum res = glClientWaitSync(waiter.sync, 0, 0);
+        if (res == GL_ALREADY_SIGNALED || res == GL_CONDITION_SATISFIED) {
+            glDeleteSync(waiter.sync);
+            // Resumed without the lock held, it may well wait on another fence
+            waiter.handle.resume();
+            ++numSignaled;
+        } else {
+            pending.push_back(waiter);
+        }
+    }
+    polling.clear();
+
+    if (!pending.empty()) {
+        std::lock_guard lock{mutex};
+        waiters.insert(waiters.end(), pending.begin(), pending.end());
+    }
+
+    return numSignaled;
+}
+
+std::size_t FencePoller::size() const {
+    std::lock_guard lock{mutex};
+    return waiters.size();
+}
+
+DeletionQueue::~DeletionQueue() {
+    DCHECK(pending.empty() && batches.empty());
+}
+
+void DeletionQueue::push(Task&& deleter) {
+    std::lock_guard lock{mutex};
+    pending.push_back(std::move(deleter));
+}
+
+void DeletionQueue::endFrame() {
+    Batch batch;
+    {
+        std::lock_guard lock{mutex};
+        if (pending.empty())
+            return;
+
+        batch.deleters.swap(pending);
+    }
+
+    batch.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    batches.push_back(std::move(batch));
+}
+
+std::size_t DeletionQueue::collect() {
+    std::size_t numDeleted = 0;
+
+    // Fences signal in submission order, stop at the first one still pending
+    while (!batches.empty()) {
+        auto& batch = batches.front();
+
+        const GLenum res = glClientWaitSync(batch.fence, 0, 0);
+        if (res != GL_ALREADY_SIGNALED && res != GL_CONDITION_SATISFIED)
+            break;
+
+        glDeleteSync(batch.fence);
+        for (auto& deleter : batch.deleters)
+            deleter();
+
+        numDeleted += batch.deleters.size();
+        batches.pop_front();
+    }
+
+    return numDeleted;
+}
+
+void DeletionQueue::flush() {
+    endFrame();
+    glFinish();
+    collect();
+    DCHECK(batches.empty());
+}
+
+GLsync sdbox::InsertFence() {
+    GLsync sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+    return sync;
+}
\ No newline at end of file
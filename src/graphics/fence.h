@@ -0,0 +1,101 @@
+#ifndef SDBOX_FENCE_H
+#define SDBOX_FENCE_H
+
+#include <glad/glad.h>
+#include <sdbox.h>
+#include <thread.h>
+
+#include <coroutine>
+#include <deque>
+#include <functional>
+#include <mutex>
+
+namespace sdbox {
+
+// Resumes coroutines waiting on GL fences. poll() never blocks and is meant to be called
+// once per frame by the thread owning the poller's context, waiters resume on that thread.
+class FencePoller {
+public:
+    FencePoller() = default;
+    ~FencePoller();
+
+    FencePoller(const FencePoller&)            = delete;
+    FencePoller& operator=(const FencePoller&) = delete;
+
+    // Awaitable from any thread whose context shares objects with the polling one
+    auto wait(GLsync sync) {
+        struct Awaiter {
+            FencePoller& poller;
+            GLsync       sync;
+
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> handle) { poller.add(sync, handle); }
+            void await_resume() const noexcept {}
+        };
+
+        return Awaiter{*this, sync};
+    }
+
+    // Called from the waiting thread once a waiter is registered, so an idle polling thread can
+    // be woken up without missing it. Set before anyone waits.
+    void setNotify(std::function<void()>&& callback) { notify = std::move(callback); }
+
+    // Resumes every waiter whose fence has been signaled, returns how many
+    std::size_t poll();
+
+    std::size_t size() const;
+
+private:
+    struct Waiter {
+        GLsync                  sync;
+        std::coroutine_handle<> handle;
+    };
+
+    void add(GLsync sync, std::coroutine_handle<> handle);
+
+    mutable std::mutex    mutex;
+    std::vector<Waiter>   waiters;
+    std::vector<Waiter>   polling;
+    std::function<void()> notify;
+};
+
+// Defers destruction of GL objects until the GPU retired every frame that could still use them.
+// Deleters can be pushed from any thread; the rest is called by the thread owning the context,
+// which is where the deleters end up running.
+class DeletionQueue {
+public:
+    DeletionQueue() = default;
+    ~DeletionQueue();
+
+    DeletionQueue(const DeletionQueue&)            = delete;
+    DeletionQueue& operator=(const DeletionQueue&) = delete;
+
+    void push(Task&& deleter);
+
+    // Fences everything pushed so far behind the commands submitted this frame
+    void endFrame();
+
+    // Runs deleters of retired frames without blocking, returns how many ran
+    std::size_t collect();
+
+    // Waits for the GPU and runs every deleter, for teardown
+    void flush();
+
+private:
+    struct Batch {
+        GLsync            fence = nullptr;
+        std::vector<Task> deleters;
+    };
+
+    std::mutex        mutex;
+    std::vector<Task> pending;
+    std::deque<Batch> batches;
+};
+
+// Inserts a fence into the current context's command stream and flushes it, so that other
+// contexts waiting on it can't stall forever
+GLsync InsertFence();
+
+} // namespace sdbox
+
+#endif
\ No newline at end of file
@@ -0,0 +1,58 @@
+#include <framebuffer.h>
+
+#include <glad/glad.h>
+
+#include <algorithm>
+
+using namespace sdbox;
+
+RenderTarget::RenderTarget(ImageFormat fmt) : fmt(fmt), color(Texture::Type::Tex2D, fmt, 1) {
+    color.setSampler(
+        {.s   = Wrap::ClampEdge,
+         .t   = Wrap::ClampEdge,
+         .min = Filter::Linear,
+         .mag = Filter::Linear});
+
+    glCreateFramebuffers(1, &fbo);
+    glNamedFramebufferTexture(fbo, GL_COLOR_ATTACHMENT0, color.id(), 0);
+
+    if (glCheckNamedFramebufferStatus(fbo, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        LOG_ERROR("Render target {}x{} is incomplete.", fmt.width, fmt.height);
+}
+
+RenderTarget::~RenderTarget() {
+    if (fbo != 0)
+        glDeleteFramebuffers(1, &fbo);
+}
+
+void RenderTarget::bind() const {
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glViewport(0, 0, fmt.width, fmt.height);
+}
+
+void RenderTarget::clear() const {
+    const float zero[] = {0.0f, 0.0f, 0.0f, 0.0f};
+    glClearNamedFramebufferfv(fbo, GL_COLOR, 0, zero);
+}
+
+std::unique_ptr<RenderTarget> RenderTargetPool::acquire(ImageFormat fmt) {
+    auto it = free.find(MakeKey(fmt));
+    if (it == free.end())
+        return std::make_unique<RenderTarget>(fmt);
+
+    auto target = std::move(it->second.target);
+    free.erase(it);
+
+    return target;
+}
+
+void RenderTargetPool::release(std::unique_ptr<RenderTarget>&& target) {
+    if (target)
+        free.emplace(MakeKey(target->format()), Idle{releases++, std::move(target)});
+}
+
+void RenderTargetPool::trim(std::size_t maxIdle) {
+    while (free.size() > maxIdle)
+        free.erase(std::ranges::min_element(
+            free, {}, [](const auto& entry) { return entry.second.released; }));
+}
\ No newline at end of file
@@ -0,0 +1,68 @@
+#ifndef SDBOX_FRAMEBUFFER_H
+#define SDBOX_FRAMEBUFFER_H
+
+#include <sdbox.h>
+#include <texture.h>
+
+#include <map>
+
+namespace sdbox {
+
+// Framebuffer with a single color attachment it owns
+class RenderTarget {
+public:
+    explicit RenderTarget(ImageFormat fmt);
+    ~RenderTarget();
+
+    RenderTarget(const RenderTarget&)            = delete;
+    RenderTarget& operator=(const RenderTarget&) = delete;
+
+    void bind() const;
+    void clear() const;
+
+    unsigned int   id() const { return fbo; }
+    const Texture& texture() const { return color; }
+    ImageFormat    format() const { return fmt; }
+
+private:
+    ImageFormat  fmt;
+    Texture      color;
+    unsigned int fbo = 0;
+};
+
+// Recycles render targets by size and format instead of recreating them
+class RenderTargetPool {
+public:
+    RenderTargetPool() = default;
+
+    RenderTargetPool(const RenderTargetPool&)            = delete;
+    RenderTargetPool& operator=(const RenderTargetPool&) = delete;
+
+    std::unique_ptr<RenderTarget> acquire(ImageFormat fmt);
+    void                          release(std::unique_ptr<RenderTarget>&& target);
+
+    // Frees every idle target
+    void clear() { free.clear(); }
+
+    // Frees the least recently released targets until at most maxIdle are left
+    void trim(std::size_t maxIdle);
+
+    std::size_t size() const { return free.size(); }
+
+private:
+    using Key = std::tuple<int, int, PixelFormat, int>;
+
+    static Key MakeKey(ImageFormat fmt) { return {fmt.width, fmt.height, fmt.pFmt, fmt.nChannels}; }
+
+    struct Idle {
+        std::uint64_t                 released;
+        std::unique_ptr<RenderTarget> target;
+    };
+
+    std::multimap<Key, Idle> free;
+    std::uint64_t            releases = 0;
+};
+
+} // namespace sdbox
+
+#endif
\ No newline at end of file
@@ -0,0 +1,222 @@
+#include <gputimer.h>
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cmath>
+#include <format>
+
+using namespace sdbox;
+
+namespace {
+// Nearest rank percentile of a sorted, non empty series
+double Percentile(const std::vector<double>& sorted, double p) {
+    const auto rank = static_cast<std::size_t>(std::ceil(p * static_cast<double>(sorted.size())));
+    return sorted[std::clamp<std::size_t>(rank, 1, sorted.size()) - 1];
+}
+} // namespace
+
+TimingStats sdbox::SummarizeTimes(std::span<const double> times) {
+    if (times.empty())
+        return {};
+
+    std::vector<double> sorted(times.begin(), times.end());
+    std::ranges::sort(sorted);
+
+    double sum = 0.0;
+    for (auto t : sorted)
+        sum += t;
+
+    return TimingStats{
+        .min   = sorted.front(),
+        .avg   = sum / static_cast<double>(sorted.size()),
+        .p50   = Percentile(sorted, 0.50),
+        .p95   = Percentile(sorted, 0.95),
+        .p99   = Percentile(sorted, 0.99),
+        .max   = sorted.back(),
+        .count = sorted.size()};
+}
+
+std::string sdbox::ToJson(const TimingStats& stats) {
+    return std::format(
+        "{{\"min\": {:.4f}, \"avg\": {:.4f}, \"p50\": {:.4f}, \"p95\": {:.4f}, "
+        "\"p99\": {:.4f}, \"max\": {:.4f}, \"count\": {}}}",
+        stats.min, stats.avg, stats.p50, stats.p95, stats.p99, stats.max, stats.count);
+}
+
+GpuTimer::GpuTimer(int depth, std::size_t window) : frames(depth), window(window) {}
+
+GpuTimer::~GpuTimer() {
+    for (auto& frame : frames)
+        glDeleteQueries(static_cast<GLsizei>(frame.queries.size()), frame.queries.data());
+}
+
+void GpuTimer::beginFrame() {
+    // Every frame is waiting on the GPU, this one goes unmeasured
+    active = inFlight < static_cast<int>(frames.size());
+    if (!active)
+        return;
+
+    auto& frame = frames[next];
+    frame.used  = 0;
+    frame.records.clear();
+    open.clear();
+
+    begin(FrameScope);
+}
+
+void GpuTimer::endFrame() {
+    if (!active)
+        return;
+
+    // Scopes left open end with the frame
+    while (!open.empty())
+        end();
+
+    next = (next + 1) % static_cast<int>(frames.size());
+    ++inFlight;
+    active = false;
+}
+
+void GpuTimer::begin(std::string_view name) {
+    if (!active)
+        return;
+
+    auto& frame = frames[next];
+    open.push_back(frame.records.size());
+    frame.records.push_back({.scope = scopeIndex(name), .start = timestamp(frame), .stop = 0});
+}
+
+void GpuTimer::end() {
+    if (!active || open.empty())
+        return;
+
+    auto& frame                     = frames[next];
+    frame.records[open.back()].stop = timestamp(frame);
+    open.pop_back();
+}
+
+std::optional<double> GpuTimer::poll() {
+    const int depth = static_cast<int>(frames.size());
+
+    std::optional<double> latest;
+    std::vector<GLuint64> stamps;
+    std::vector<double>   totals;
+    std::vector<char>     seen;
+
+    while (inFlight > 0) {
+        auto& frame = frames[(next + depth - inFlight) % depth];
+
+        // Timestamps land in order, the last one of the frame is the first to check
+        GLint available = GL_FALSE;
+        glGetQueryObjectiv(frame.queries[frame.used - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            break;
+
+        stamps.resize(frame.used);
+        for (std::size_t i = 0; i < frame.used; ++i)
+            glGetQueryObjectui64v(frame.queries[i], GL_QUERY_RESULT, &stamps[i]);
+
+        totals.assign(series.size(), 0.0);
+        seen.assign(series.size(), false);
+        for (const auto& rec : frame.records) {
+            totals[rec.scope] += static_cast<double>(stamps[rec.stop] - stamps[rec.start]) * 1e-6;
+            seen[rec.scope] = true;
+        }
+
+        for (std::size_t s = 0; s < series.size(); ++s) {
+            if (!seen[s])
+                continue;
+
+            auto& times = series[s].times;
+            if (times.size() < window)
+                times.push_back(totals[s]);
+            else
+                times[series[s].next] = totals[s];
+            series[s].next = (series[s].next + 1) % window;
+        }
+
+        // The frame scope is always the first record
+        latest = totals[frame.records.front().scope];
+        --inFlight;
+    }
+
+    return latest;
+}
+
+void GpuTimer::finish() {
+    glFinish();
+    poll();
+}
+
+bool GpuTimer::Supported() {
+    GLint bits = 0;
+    glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &bits);
+    return bits > 0;
+}
+
+std::vector<std::pair<std::string, TimingStats>> GpuTimer::stats() const {
+    std::vector<std::pair<std::string, TimingStats>> result;
+    for (const auto& s : series)
+        if (!s.times.empty())
+            result.emplace_back(s.name, SummarizeTimes(s.times));
+
+    return result;
+}
+
+std::optional<TimingStats> GpuTimer::stats(std::string_view name) const {
+    for (const auto& s : series)
+        if (s.name == name && !s.times.empty())
+            return SummarizeTimes(s.times);
+
+    return std::nullopt;
+}
+
+std::string GpuTimer::summary() const {
+    std::string result = "GPU times (ms):";
+    for (const auto& [name, st] : stats())
+        result += std::format(
+            "\n  {:<10} min {:7.3f}  avg {:7.3f}  p99 {:7.3f}  max {:7.3f}  ({} frames)", name,
+            st.min, st.avg, st.p99, st.max, st.count);
+
+    return result;
+}
+
+std::string GpuTimer::json() const {
+    std::string result = "{";
+    for (const auto& [name, st] : stats()) {
+        if (result.size() > 1)
+            result += ", ";
+        result += std::format("\"{}\": {}", name, ToJson(st));
+    }
+
+    return result + "}";
+}
+
+void GpuTimer::reset() {
+    for (auto& s : series) {
+        s.times.clear();
+        s.next = 0;
+    }
+}
+
+std::size_t GpuTimer::scopeIndex(std::string_view name) {
+    for (std::size_t i = 0; i < series.size(); ++i)
+        if (series[i].name == name)
+            return i;
+
+    series.push_back({.name = std::string{name}, .times = {}, .next = 0});
+    series.back().times.reserve(window);
+    return series.size() - 1;
+}
+
+std::size_t GpuTimer::timestamp(Frame& frame) {
+    if (frame.used == frame.queries.size()) {
+        GLuint query = 0;
+        glCreateQueries(GL_TIMESTAMP, 1, &query);
+        frame.queries.push_back(query);
+    }
+
+    glQueryCounter(frame.queries[frame.used], GL_TIMESTAMP);
+    return frame.used++;
+}
\ No newline at end of file
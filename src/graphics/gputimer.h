@@ -0,0 +1,103 @@
+#ifndef SDBOX_GPUTIMER_H
+#define SDBOX_GPUTIMER_H
+
+#include <sdbox.h>
+
+#include <optional>
+#include <span>
+#include <string_view>
+
+namespace sdbox {
+
+// Summary of a series of times in milliseconds
+struct TimingStats {
+    double      min   = 0.0;
+    double      avg   = 0.0;
+    double      p50   = 0.0;
+    double      p95   = 0.0;
+    double      p99   = 0.0;
+    double      max   = 0.0;
+    std::size_t count = 0;
+};
+
+TimingStats SummarizeTimes(std::span<const double> times);
+
+// JSON object with every field of stats
+std::string ToJson(const TimingStats& stats);
+
+// GPU time of named scopes within a frame, from timestamp queries. Every frame in flight owns
+// its own queries, which are only read once a later frame finds them available, so measuring
+// never stalls the pipeline. Frames are skipped while every set is still in flight. Scopes
+// may nest, a scope opened more than once per frame adds up.
+class GpuTimer {
+public:
+    static constexpr std::string_view FrameScope = "frame";
+
+    // depth frames in flight, statistics over the last window measured frames
+    explicit GpuTimer(int depth = 4, std::size_t window = 512);
+    ~GpuTimer();
+
+    GpuTimer(const GpuTimer&)            = delete;
+    GpuTimer& operator=(const GpuTimer&) = delete;
+
+    // Opens and closes the frame scope
+    void beginFrame();
+    void endFrame();
+
+    void begin(std::string_view name);
+    void end();
+
+    // Collects finished frames, returns the latest frame time in milliseconds if any finished
+    std::optional<double> poll();
+
+    // Waits for the GPU and collects every frame in flight
+    void finish();
+
+    // Whether the context counts timestamps at all
+    static bool Supported();
+
+    // Per scope, in the order scopes first appeared
+    std::vector<std::pair<std::string, TimingStats>> stats() const;
+    std::optional<TimingStats>                       stats(std::string_view name) const;
+
+    // Readable table and JSON of stats()
+    std::string summary() const;
+    std::string json() const;
+
+    void reset();
+
+private:
+    struct Record {
+        std::size_t scope;
+        std::size_t start;
+        std::size_t stop;
+    };
+
+    struct Frame {
+        std::vector<unsigned int> queries; // Grows to the most scopes a frame had
+        std::vector<Record>       records;
+        std::size_t               used = 0;
+    };
+
+    struct Series {
+        std::string         name;
+        std::vector<double> times; // Ring of the last window samples
+        std::size_t         next = 0;
+    };
+
+    std::size_t scopeIndex(std::string_view name);
+    std::size_t timestamp(Frame& frame);
+
+    std::vector<Frame>       frames;
+    std::vector<Series>      series;
+    std::vector<std::size_t> open; // Records of the scopes not ended yet
+
+    std::size_t window;
+    int         next     = 0;
+    int         inFlight = 0;
+    bool        active   = false;
+};
+
+} // namespace sdbox
+
+#endif
\ No newline at end of file
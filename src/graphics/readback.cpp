@@ -0,0 +1,102 @@
+#include <readback.h>
+#include <fence.h>
+
+#include <chrono>
+
+using namespace sdbox;
+using namespace std::chrono;
+using namespace std::chrono_literals;
+
+namespace {
+// Every wait is bounded, a GPU that stops making progress ends in an error instead of a hang
+constexpr nanoseconds FenceTimeout  = 100ms;
+constexpr int         MaxFenceWaits = 50;
+} // namespace
+
+ReadbackRing::ReadbackRing(ImageFormat fmt, int depth, ThreadPool& pool, ConsumeFunc&& consume)
+    : fmt(fmt), pool(pool), consume(std::move(consume)), maxSlots(depth * MaxGrowth) {
+    DCHECK(depth > 0);
+
+    for (int i = 0; i < depth; ++i)
+        addSlot(slots.size());
+}
+
+ReadbackRing::~ReadbackRing() {
+    finish();
+}
+
+void ReadbackRing::read(const RenderTarget& target, int frame) {
+    DCHECK(target.format().width == fmt.width && target.format().height == fmt.height);
+
+    // Every slot holds a copy nobody consumed yet, the oldest one goes first
+    if (inFlight == slots.size())
+        consumeOldest(true);
+
+    // Its consumer may still be reading from the mapping, copy to a new slot instead. Inserting
+    // right at next keeps the copies in flight in order just before it.
+    if (!slots[next]->consumer.done() && slots.size() < maxSlots) {
+        addSlot(next);
+        LOGD("Readback consumers fell behind, grew the ring to {} slots.", slots.size());
+    }
+
+    auto& slot = *slots[next];
+    pool.wait(slot.consumer);
+
+    target.texture().readback(slot.pbo.id());
+    slot.fence = InsertFence();
+    slot.frame = frame;
+
+    next = (next + 1) % slots.size();
+    ++inFlight;
+}
+
+std::size_t ReadbackRing::poll() {
+    std::size_t numConsumed = 0;
+    while (inFlight > 0 && consumeOldest(false))
+        ++numConsumed;
+
+    return numConsumed;
+}
+
+void ReadbackRing::finish() {
+    while (inFlight > 0)
+        consumeOldest(true);
+
+    for (auto& slot : slots)
+        pool.wait(slot->consumer);
+}
+
+void ReadbackRing::addSlot(std::size_t pos) {
+    // Coherent, so a signaled fence is all it takes for the pixels to be visible
+    constexpr auto flags = BufferFlag::Read | BufferFlag::Persistent | BufferFlag::Coherent;
+
+    auto slot = std::make_unique<Slot>();
+    slot->pbo.create(BufferType::PixelPack, ImageSize(fmt), flags, nullptr);
+    slots.insert(slots.begin() + static_cast<std::ptrdiff_t>(pos), std::move(slot));
+}
+
+bool ReadbackRing::consumeOldest(bool wait) {
+    auto& slot = *slots[(next + slots.size() - inFlight) % slots.size()];
+
+    // Copies finish in submission order, so checking the oldest is enough
+    const GLuint64 timeout = wait ? FenceTimeout.count() : 0;
+    GLenum         res     = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+    for (int tries = 1; wait && res == GL_TIMEOUT_EXPIRED && tries < MaxFenceWaits; ++tries)
+        res = glClientWaitSync(slot.fence, 0, timeout);
+
+    if (res == GL_TIMEOUT_EXPIRED && !wait)
+        return false;
+
+    if (res == GL_TIMEOUT_EXPIRED || res == GL_WAIT_FAILED)
+        FATAL("Readback of frame {} never finished, the GPU stopped responding.", slot.frame);
+
+    glDeleteSync(slot.fence);
+    slot.fence = nullptr;
+    --inFlight;
+
+    pool.submit(slot.consumer, [this, &slot]() {
+        consume({.frame = slot.frame, .format = fmt, .pixels = slot.pbo.get<std::byte>()});
+    });
+
+    return true;
+}
\ No newline at end of file
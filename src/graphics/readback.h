@@ -0,0 +1,72 @@
+#ifndef SDBOX_READBACK_H
+#define SDBOX_READBACK_H
+
+#include <sdbox.h>
+#include <buffer.h>
+#include <framebuffer.h>
+#include <thread.h>
+
+#include <functional>
+
+namespace sdbox {
+
+// Pixels of a frame in CPU visible memory, only valid during the consume call
+struct ReadbackFrame {
+    int              frame = 0;
+    ImageFormat      format;
+    const std::byte* pixels = nullptr;
+};
+
+// Pipelined readback of render targets. Each slot owns a persistently mapped pixel pack buffer,
+// a copy is only touched by the CPU once its fence signaled, which gives the GPU up to depth
+// frames of slack. Finished frames are consumed on the pool straight from the mapped memory,
+// the slot is reused once its consumer returns.
+class ReadbackRing {
+public:
+    using ConsumeFunc = std::function<void(const ReadbackFrame&)>;
+
+    static constexpr int MaxGrowth = 4;
+
+    ReadbackRing(ImageFormat fmt, int depth, ThreadPool& pool, ConsumeFunc&& consume);
+    ~ReadbackRing();
+
+    ReadbackRing(const ReadbackRing&)            = delete;
+    ReadbackRing& operator=(const ReadbackRing&) = delete;
+
+    // Starts copying the target. Slots whose consumer is still busy are skipped by adding a
+    // new one, up to MaxGrowth times the initial depth, so slow consumers don't stall the
+    // caller. Blocks when the GPU fell every slot behind or the ring can't grow anymore.
+    void read(const RenderTarget& target, int frame);
+
+    // Hands every finished copy to the consumers without blocking, returns how many
+    std::size_t poll();
+
+    // Waits for every copy and consumer
+    void finish();
+
+    std::size_t depth() const { return slots.size(); }
+
+private:
+    struct Slot {
+        Buffer    pbo;
+        GLsync    fence = nullptr;
+        int       frame = 0;
+        TaskLatch consumer;
+    };
+
+    bool consumeOldest(bool wait);
+    void addSlot(std::size_t pos);
+
+    ImageFormat fmt;
+    ThreadPool& pool;
+    ConsumeFunc consume;
+
+    std::vector<std::unique_ptr<Slot>> slots;
+    std::size_t                        maxSlots = 0;
+    std::size_t                        next     = 0; // Slot the next copy goes to
+    std::size_t                        inFlight = 0; // Copies not handed to consumers yet
+};
+
+} // namespace sdbox
+
+#endif
\ No newline at end of file
@@ -175,6 +175,12 @@ ProgramBinary Program::getBinary() const {
     return bin;
 }
 
+std::size_t Program::memorySize() const {
+    GLint binSize = 0;
+    glGetProgramiv(handle, GL_PROGRAM_BINARY_LENGTH, &binSize);
+    return binSize;
+}
+
 void Program::cleanShaders() {
     for (auto sid : srcHandles)
         if (glIsShader(sid) == GL_TRUE)
@@ -214,7 +220,7 @@ ShaderType sdbox::DeduceShaderType(const std::string& fileName) {
 }
 
 std::unique_ptr<Shader>
-LoadShaderFromMemory(const std::string& name, const char* bytes, std::size_t size) {
+sdbox::LoadShaderFromMemory(const std::string& name, const char* bytes, std::size_t size) {
     std::string contents{bytes, size};
     ShaderType  type = DeduceShaderType(name);
     return std::make_unique<Shader>(name, type, contents);
@@ -27,6 +27,8 @@ public:
     const std::string& getName() const { return name; }
     const std::string& getSource() const { return source; }
 
+    std::size_t memorySize() const { return source.size(); }
+
 private:
     std::string getVersion();
     bool        hasVersionDir();
@@ -60,6 +62,9 @@ public:
 
     ProgramBinary getBinary() const;
 
+    // Size of the linked binary, as reported by the driver
+    std::size_t memorySize() const;
+
 private:
     std::vector<unsigned int> srcHandles;
     std::string               name;
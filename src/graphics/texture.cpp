@@ -147,6 +147,12 @@ std::unique_ptr<std::byte[]> Texture::data(int level) const {
     return dataPtr;
 }
 
+void Texture::readback(unsigned int packBuffer, int level) const {
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, packBuffer);
+    glGetTextureImage(handle, level, info->format, info->type, sizeBytes(level), nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
 std::unique_ptr<std::byte[]> Texture::data(int face, int level) const {
     auto size    = sizeBytesFace(level);
     auto dataPtr = std::make_unique<std::byte[]>(size);
@@ -215,6 +221,13 @@ std::size_t Texture::sizeBytesFace(unsigned int level) const {
     return ComponentSize(info->pxFmt) * info->numChannels * w * h * d;
 }
 
+std::size_t Texture::memorySize() const {
+    std::size_t total = 0;
+    for (int lvl = 0; lvl < levels; ++lvl)
+        total += sizeBytes(lvl);
+    return total;
+}
+
 ImageFormat Texture::format(int lvl) const {
     const auto w = width == 0 ? 0 : ResizeLvl(width, lvl);
     const auto h = height == 0 ? 0 : ResizeLvl(height, lvl);
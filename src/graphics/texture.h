@@ -45,8 +45,14 @@ public:
     void upload(const Image& image, int level = 0) const;
     void upload(const CubeImage& cubemap) const;
 
+    // Asynchronous copy of a level into the start of a pixel pack buffer
+    void readback(unsigned int packBuffer, int level = 0) const;
+
     ImageFormat format(int level = 0) const;
 
+    // All levels and faces
+    std::size_t memorySize() const;
+
     std::unique_ptr<Image>     image(int level = 0) const;
     std::unique_ptr<CubeImage> cubemap() const;
 
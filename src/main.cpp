@@ -1,7 +1,175 @@
 #include <app.h>
 
-int main() {
-    sdbox::SdboxApp app{};
-    app.init("testFolder");
+#include <charconv>
+
+using namespace sdbox;
+
+namespace {
+void PrintUsage() {
+    std::cerr << "Usage: sdbox [folder] [--headless egl|osmesa] [--size WxH] [--frames N]\n"
+                 "             [--workers N] [--gl-workers N]\n"
+                 "             [--offline FIRST:LAST] [--fps F] [--out FOLDER]\n"
+                 "             [--capture FILE|\"|COMMAND\"] [--capture-format y4m|rgba]\n"
+                 "             [--tiled WxH] [--tile-size N] [--tiled-out FILE]\n"
+                 "             [--accumulate] [--max-samples N] [--tolerance E] [--hdr-out FILE]\n"
+                 "             [--target-ms MS] [--min-scale S] [--gpu-stats FILE]\n"
+                 "             [--on-demand] [--vsync on|off|adaptive] [--fps-limit F]\n"
+                 "             [--frames-in-flight N] [--low-latency]\n"
+                 "             [--benchmark N] [--warmup N] [--bench-out FILE]\n";
+}
+
+template<typename T>
+bool ParseNumber(std::string_view str, T& val) {
+    auto [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(), val);
+    return ec == std::errc{} && ptr == str.data() + str.size();
+}
+
+bool ParseInt(std::string_view str, int& val) {
+    return ParseNumber(str, val) && val > 0;
+}
+
+bool ParseSize(std::string_view str, int& width, int& height) {
+    const auto x = str.find('x');
+    return x != std::string_view::npos && ParseInt(str.substr(0, x), width) &&
+           ParseInt(str.substr(x + 1), height);
+}
+
+bool ParseArgs(int argc, char** argv, fs::path& folder, AppOpts& opts) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+
+        if (!arg.starts_with("--")) {
+            folder = arg;
+            continue;
+        }
+
+        if (arg == "--accumulate") {
+            opts.accumulate.enabled = true;
+            continue;
+        }
+
+        if (arg == "--on-demand") {
+            opts.onDemand = true;
+            continue;
+        }
+
+        if (arg == "--low-latency") {
+            opts.pacing.lowLatency = true;
+            continue;
+        }
+
+        // Every other option takes a value
+        if (i + 1 == argc)
+            return false;
+
+        const std::string_view val = argv[++i];
+        if (arg == "--headless") {
+            if (val == "egl")
+                opts.backend = ContextBackend::EGL;
+            else if (val == "osmesa")
+                opts.backend = ContextBackend::OSMesa;
+            else
+                return false;
+        } else if (arg == "--size") {
+            if (!ParseSize(val, opts.width, opts.height))
+                return false;
+        } else if (arg == "--tiled") {
+            if (!ParseSize(val, opts.tiled.width, opts.tiled.height))
+                return false;
+        } else if (arg == "--tile-size") {
+            if (!ParseInt(val, opts.tiled.tileSize))
+                return false;
+        } else if (arg == "--tiled-out") {
+            opts.tiled.output = val;
+        } else if (arg == "--frames") {
+            if (!ParseInt(val, opts.maxFrames))
+                return false;
+        } else if (arg == "--workers") {
+            if (!ParseInt(val, opts.numWorkers))
+                return false;
+        } else if (arg == "--gl-workers") {
+            if (!ParseInt(val, opts.numGLWorkers))
+                return false;
+        } else if (arg == "--offline") {
+            auto& offline = opts.offline;
+
+            const auto sep = val.find(':');
+            if (sep == std::string_view::npos ||
+                !ParseNumber(val.substr(0, sep), offline.firstFrame) ||
+                !ParseNumber(val.substr(sep + 1), offline.lastFrame) || !offline.enabled())
+                return false;
+        } else if (arg == "--fps") {
+            if (!ParseNumber(val, opts.offline.frameRate) || opts.offline.frameRate <= 0.0)
+                return false;
+        } else if (arg == "--out") {
+            opts.offline.outputDir = val;
+        } else if (arg == "--max-samples") {
+            if (!ParseInt(val, opts.accumulate.maxSamples))
+                return false;
+        } else if (arg == "--tolerance") {
+            if (!ParseNumber(val, opts.accumulate.tolerance) || opts.accumulate.tolerance <= 0.0f)
+                return false;
+        } else if (arg == "--hdr-out") {
+            opts.accumulate.hdrOutput = val;
+        } else if (arg == "--target-ms") {
+            if (!ParseNumber(val, opts.targetMs) || opts.targetMs <= 0.0)
+                return false;
+        } else if (arg == "--min-scale") {
+            if (!ParseNumber(val, opts.minScale) || opts.minScale <= 0.0 || opts.minScale > 1.0)
+                return false;
+        } else if (arg == "--gpu-stats") {
+            opts.gpuStats = val;
+        } else if (arg == "--capture") {
+            opts.capture.target = val;
+        } else if (arg == "--capture-format") {
+            if (val == "y4m")
+                opts.capture.format = VideoFormat::Y4M;
+            else if (val == "rgba")
+                opts.capture.format = VideoFormat::RawRGBA;
+            else
+                return false;
+        } else if (arg == "--vsync") {
+            if (val == "on")
+                opts.pacing.vsync = VSync::On;
+            else if (val == "off")
+                opts.pacing.vsync = VSync::Off;
+            else if (val == "adaptive")
+                opts.pacing.vsync = VSync::Adaptive;
+            else
+                return false;
+        } else if (arg == "--benchmark") {
+            if (!ParseInt(val, opts.benchmark.frames))
+                return false;
+        } else if (arg == "--warmup") {
+            if (!ParseNumber(val, opts.benchmark.warmup) || opts.benchmark.warmup < 0)
+                return false;
+        } else if (arg == "--bench-out") {
+            opts.benchmark.output = val;
+        } else if (arg == "--fps-limit") {
+            if (!ParseNumber(val, opts.pacing.fpsLimit) || opts.pacing.fpsLimit <= 0.0)
+                return false;
+        } else if (arg == "--frames-in-flight") {
+            auto& frames = opts.pacing.framesInFlight;
+            if (!ParseInt(val, frames) || frames > 8)
+                return false;
+        } else {
+            return false;
+        }
+    }
+
+    return true;
+}
+} // namespace
+
+int main(int argc, char** argv) {
+    fs::path folder = "testFolder";
+    AppOpts  opts;
+    if (!ParseArgs(argc, argv, folder, opts)) {
+        PrintUsage();
+        return 1;
+    }
+
+    SdboxApp app{};
+    app.init(folder, opts);
     app.loop();
 }
\ No newline at end of file
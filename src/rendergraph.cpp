@@ -0,0 +1,182 @@
+#include <rendergraph.h>
+
+#include <glad/glad.h>
+#include <graphics.h>
+
+#include <bit>
+#include <utility>
+
+using namespace sdbox;
+
+namespace {
+constexpr ImageFormat TargetFormat(int width, int height) {
+    return {PixelFormat::F32, width, height, 0, 4};
+}
+} // namespace
+
+std::uint32_t RenderGraph::ReadsMask(std::string_view source) {
+    std::uint32_t mask = 0;
+    for (int b = 0; b < NumBuffers; ++b)
+        if (source.find(BufferSamplers[b]) != std::string_view::npos)
+            mask |= 1u << b;
+    return mask;
+}
+
+int RenderGraph::BufferIndex(std::string_view fileName) {
+    for (int b = 0; b < NumBuffers; ++b)
+        if (fileName == BufferFiles[b])
+            return b;
+    return -1;
+}
+
+void RenderGraph::setPass(int idx, unsigned int program, std::uint32_t reads) {
+    DCHECK_LT(idx, NumBuffers);
+
+    auto& pass = passes[idx];
+    if (program == 0)
+        releaseTargets(pass);
+
+    dirty        = dirty || pass.program != program || pass.reads != reads;
+    pass.program = program;
+    pass.reads   = reads;
+}
+
+void RenderGraph::resize(int w, int h) {
+    if (w == width && h == height)
+        return;
+
+    const auto fmt = TargetFormat(w, h);
+
+    for (auto& pass : passes) {
+        for (auto& target : pass.targets) {
+            if (!target)
+                continue;
+
+            auto        resized = targetPool.acquire(fmt);
+            const auto& old     = target->format();
+            glBlitNamedFramebuffer(
+                target->id(), resized->id(), 0, 0, old.width, old.height, 0, 0, w, h,
+                GL_COLOR_BUFFER_BIT, GL_LINEAR);
+
+            targetPool.release(std::exchange(target, std::move(resized)));
+        }
+    }
+
+    // Old sizes stay pooled for a while, the resolution scaler often goes back to them
+    targetPool.trim(MaxIdleTargets);
+
+    width  = w;
+    height = h;
+}
+
+void RenderGraph::allocateTargets(Pass& pass) {
+    const auto fmt = TargetFormat(width, height);
+
+    // Dropping to a single target keeps the one holding the latest output
+    if (!pass.history && pass.current == 1) {
+        std::swap(pass.targets[0], pass.targets[1]);
+        pass.current = 0;
+    }
+
+    const int numTargets = pass.history ? 2 : 1;
+    for (int t = 0; t < 2; ++t) {
+        auto& target = pass.targets[t];
+        if (t < numTargets && !target) {
+            target = targetPool.acquire(fmt);
+            target->clear();
+        } else if (t >= numTargets && target) {
+            targetPool.release(std::move(target));
+        }
+    }
+}
+
+void RenderGraph::releaseTargets(Pass& pass) {
+    for (auto& target : pass.targets)
+        targetPool.release(std::move(target));
+
+    pass.current = 0;
+}
+
+void RenderGraph::build() {
+    // Kahn's algorithm over "reads from" edges, self reads don't constrain the order
+    std::array<int, NumBuffers> inDegree{};
+    std::uint32_t               remaining = 0;
+    for (int b = 0; b < NumBuffers; ++b)
+        if (passes[b].program != 0)
+            remaining |= 1u << b;
+
+    for (int b = 0; b < NumBuffers; ++b)
+        if (remaining & (1u << b))
+            inDegree[b] = std::popcount(passes[b].reads & remaining & ~(1u << b));
+
+    order.clear();
+    while (remaining) {
+        int next = -1;
+        for (int b = 0; b < NumBuffers && next < 0; ++b)
+            if ((remaining & (1u << b)) && inDegree[b] == 0)
+                next = b;
+
+        // Cycle, break it at the first buffer left, its inputs will be last frame's
+        if (next < 0)
+            next = std::countr_zero(remaining);
+
+        order.push_back(next);
+        remaining &= ~(1u << next);
+
+        for (int b = 0; b < NumBuffers; ++b)
+            if ((remaining & (1u << b)) && (passes[b].reads & (1u << next)))
+                --inDegree[b];
+    }
+
+    // A buffer needs last frame's output if it is read before, or by, its own pass
+    for (std::size_t i = 0; i < order.size(); ++i) {
+        auto& pass   = passes[order[i]];
+        pass.history = false;
+
+        for (std::size_t j = 0; j <= i; ++j)
+            if (passes[order[j]].reads & (1u << order[i]))
+                pass.history = true;
+
+        allocateTargets(pass);
+    }
+
+    dirty = false;
+}
+
+void RenderGraph::execute(GpuTimer* timer) {
+    if (dirty)
+        build();
+
+    if (order.empty() || width == 0 || height == 0)
+        return;
+
+    for (auto idx : order) {
+        auto& pass = passes[idx];
+
+        // Ping-pong buffers write the target they didn't write last frame
+        const int write = pass.history ? 1 - pass.current : pass.current;
+
+        if (timer)
+            timer->begin(BufferFiles[idx].substr(0, BufferFiles[idx].find('.')));
+
+        bindOutputs();
+        pass.targets[write]->bind();
+        glUseProgram(pass.program);
+        RenderQuad();
+
+        if (timer)
+            timer->end();
+
+        pass.current = write;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, width, height);
+    bindOutputs();
+}
+
+void RenderGraph::bindOutputs() const {
+    for (int b = 0; b < NumBuffers; ++b)
+        if (auto output = passes[b].output())
+            glBindTextureUnit(FirstUnit + b, output->texture().id());
+}
\ No newline at end of file
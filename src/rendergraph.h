@@ -0,0 +1,92 @@
+#ifndef SDBOX_RENDERGRAPH_H
+#define SDBOX_RENDERGRAPH_H
+
+#include <sdbox.h>
+#include <framebuffer.h>
+#include <gputimer.h>
+
+#include <algorithm>
+#include <array>
+#include <string_view>
+
+namespace sdbox {
+
+// Buffer passes rendered before the main image. Each pass draws a full screen quad into its
+// own float target and may sample any buffer through uBufferA..D. Passes run in dependency
+// order; reading a buffer that renders later in the frame, or itself, sees last frame's
+// output, so those buffers are ping-ponged between two targets.
+class RenderGraph {
+public:
+    static constexpr int NumBuffers = 4;
+    static constexpr int FirstUnit  = 8; // Texture unit of uBufferA, matches builtins.glsl
+
+    static constexpr std::array<std::string_view, NumBuffers> BufferFiles = {
+        "bufferA.glsl", "bufferB.glsl", "bufferC.glsl", "bufferD.glsl"};
+
+    static constexpr std::array<std::string_view, NumBuffers> BufferSamplers = {
+        "uBufferA", "uBufferB", "uBufferC", "uBufferD"};
+
+    RenderGraph() = default;
+
+    RenderGraph(const RenderGraph&)            = delete;
+    RenderGraph& operator=(const RenderGraph&) = delete;
+
+    // Installs the program of buffer idx, or removes the pass if program is 0. reads is a mask
+    // of the buffers its source samples.
+    void setPass(int idx, unsigned int program, std::uint32_t reads);
+
+    // Resamples every output to the new size, so feedback buffers keep their history
+    void resize(int width, int height);
+
+    // Renders every pass and leaves the latest outputs bound for whatever comes next. Each pass
+    // is timed as a scope named after its buffer when a timer is given.
+    void execute(GpuTimer* timer = nullptr);
+
+    void bindOutputs() const;
+
+    // No pass installed, valid before the next execute builds the order
+    bool empty() const {
+        return std::ranges::all_of(passes, [](const Pass& pass) { return pass.program == 0; });
+    }
+
+    // Some pass reads last frame's output, so the passes change every frame on their own
+    bool feedback() const {
+        return std::ranges::any_of(passes, [](const Pass& pass) { return pass.history; });
+    }
+
+    // Buffers sampled by a shader source
+    static std::uint32_t ReadsMask(std::string_view source);
+
+    // Buffer index of a file name, -1 if it isn't a buffer
+    static int BufferIndex(std::string_view fileName);
+
+private:
+    // Idle targets kept around for sizes a resize goes back to, a full set of one size
+    static constexpr std::size_t MaxIdleTargets = 2 * NumBuffers;
+
+    struct Pass {
+        unsigned int                                 program = 0;
+        std::uint32_t                                reads   = 0;
+        bool                                         history = false;
+        int                                          current = 0;
+        std::array<std::unique_ptr<RenderTarget>, 2> targets;
+
+        const RenderTarget* output() const { return targets[current].get(); }
+    };
+
+    void build();
+    void allocateTargets(Pass& pass);
+    void releaseTargets(Pass& pass);
+
+    std::array<Pass, NumBuffers> passes;
+    std::vector<int>             order;
+    RenderTargetPool             targetPool;
+
+    int  width  = 0;
+    int  height = 0;
+    bool dirty  = false;
+};
+
+} // namespace sdbox
+
+#endif
\ No newline at end of file
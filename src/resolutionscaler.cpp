@@ -0,0 +1,51 @@
+#include <resolutionscaler.h>
+
+using namespace sdbox;
+
+bool ResolutionScaler::update(double gpuMs) {
+    smoothed = smoothed == 0.0 ? gpuMs : (1.0 - Smoothing) * smoothed + Smoothing * gpuMs;
+
+    if (smoothed > targetMs) {
+        ++over;
+        under = 0;
+    } else if (smoothed < targetMs * Headroom) {
+        ++under;
+        over = 0;
+    } else {
+        over  = 0;
+        under = 0;
+    }
+
+    // Frame time goes with the pixel count, the square of the scale
+    if (over >= DownFrames) {
+        const double wanted = current * std::sqrt(targetMs / smoothed);
+        return setScale(std::floor(wanted / Step) * Step);
+    }
+
+    if (under >= UpFrames) {
+        const double wanted = current * std::sqrt(targetMs * Headroom / smoothed);
+        return setScale(std::max(std::floor(wanted / Step) * Step, current + Step));
+    }
+
+    return false;
+}
+
+bool ResolutionScaler::setScale(double scale) {
+    scale = std::clamp(scale, minScale, 1.0);
+
+    over  = 0;
+    under = 0;
+    if (scale == current)
+        return false;
+
+    // Expected time at the new scale, measurements of the old one are still coming
+    smoothed *= (scale * scale) / (current * current);
+    current = scale;
+    return true;
+}
+
+std::tuple<int, int> ResolutionScaler::apply(int width, int height) const {
+    return {
+        std::max(static_cast<int>(width * current), 1),
+        std::max(static_cast<int>(height * current), 1)};
+}
\ No newline at end of file
@@ -0,0 +1,44 @@
+#ifndef SDBOX_RESOLUTIONSCALER_H
+#define SDBOX_RESOLUTIONSCALER_H
+
+#include <sdbox.h>
+
+namespace sdbox {
+
+// Picks the render scale that keeps GPU frame time at a target. Frame times are smoothed and
+// only acted on after several frames past a threshold: above the target to scale down, below a
+// headroom fraction of it to scale up, so the scale doesn't oscillate around the target.
+// Scales are quantized, render targets of the same size get reused.
+class ResolutionScaler {
+public:
+    static constexpr double Step       = 1.0 / 16.0;
+    static constexpr double Headroom   = 0.8; // Only scale up below this fraction of the target
+    static constexpr int    DownFrames = 4;
+    static constexpr int    UpFrames   = 30;
+    static constexpr double Smoothing  = 0.1;
+
+    ResolutionScaler(double targetMs, double minScale) : targetMs(targetMs), minScale(minScale) {}
+
+    // Feeds a measured GPU frame time, returns whether the scale changed
+    bool update(double gpuMs);
+
+    double scale() const { return current; }
+    double frameTime() const { return smoothed; }
+
+    // Size rendered at for a window size, never empty
+    std::tuple<int, int> apply(int width, int height) const;
+
+private:
+    bool setScale(double scale);
+
+    double targetMs = 16.6;
+    double minScale = 0.25;
+    double current  = 1.0;
+    double smoothed = 0.0;
+    int    over     = 0;
+    int    under    = 0;
+};
+
+} // namespace sdbox
+
+#endif
\ No newline at end of file
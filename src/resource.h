@@ -3,9 +3,18 @@
 
 #include <sdbox.h>
 #include <util.h>
+#include <thread.h>
 #include <unordered_set>
 #include <unordered_map>
 #include <type_traits>
+#include <atomic>
+#include <mutex>
+#include <array>
+#include <deque>
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <vector>
 
 namespace sdbox {
 
@@ -22,11 +31,11 @@ const std::unordered_set BuiltinNames = {Hash("main.glsl"), Hash("texture0"), Ha
 const std::unordered_set TextureFormats = {
     Hash("exr"), Hash("hdr"), Hash("png"), Hash("jpeg"), Hash("jpg")};
 
-inline bool IsBuiltinName(const std::string& str) {
+inline bool IsBuiltinName(std::string_view str) {
     return BuiltinNames.find(HashBytes64(str)) != BuiltinNames.end();
 }
 
-inline bool IsTexture(const std::string& ext) {
+inline bool IsTexture(std::string_view ext) {
     return TextureFormats.find(HashBytes64(ext)) != TextureFormats.end();
 }
 
@@ -37,35 +46,426 @@ struct Map {
 };
 
 template<typename T>
-using Shared = std::shared_ptr<T>;
+using Unique = std::unique_ptr<T>;
 
+// ------------------------------------------------------------------
+//      Handles
+// ------------------------------------------------------------------
+// Index into a per-type pool plus the generation of the entry when it was handed out. Once the
+// resource is replaced the generation moves on and the handle stops resolving.
 template<typename T>
-using Unique = std::unique_ptr<T>;
+struct Handle {
+    std::uint32_t index      = 0;
+    std::uint32_t generation = 0; // 0 is never handed out
+
+    explicit operator bool() const { return generation != 0; }
+    bool operator==(const Handle&) const = default;
+};
+
+// Dense chunked storage handing out handles. Lookups are O(1) and lock free; entries never
+// move, so a resolved pointer stays valid until the object is retired and then collected.
+// Retired objects are only destroyed by collect(), and only while no reader holds a pin.
+template<typename T>
+class ResourcePool {
+public:
+    ResourcePool() = default;
+
+    ResourcePool(const ResourcePool&)            = delete;
+    ResourcePool& operator=(const ResourcePool&) = delete;
+
+    Handle<T> insert(Unique<T>&& object, std::size_t bytes = 0) {
+        std::lock_guard lock{mutex};
+
+        // Bound where T is complete, like shared_ptr does, so owners only need a declaration
+        if (!destroy)
+            destroy = [](T* obj) { delete obj; };
+
+        std::uint32_t idx;
+        if (!freeList.empty()) {
+            idx = freeList.back();
+            freeList.pop_back();
+        } else {
+            idx = count.load(std::memory_order_relaxed);
+            if (idx == ChunkSize * MaxChunks)
+                FATAL("Exceeded maximum number of resources ({}).", ChunkSize * MaxChunks);
+
+            if (idx % ChunkSize == 0)
+                chunks[idx / ChunkSize] = std::make_unique<Entry[]>(ChunkSize);
+        }
 
+        auto& e = entry(idx);
+        e.bytes = bytes;
+        e.object.store(object.release(), std::memory_order_relaxed);
+        totalBytes.fetch_add(bytes, std::memory_order_relaxed);
+        const auto gen = e.generation.load(std::memory_order_relaxed) + 1;
+        e.generation.store(gen, std::memory_order_seq_cst);
+
+        if (idx == count.load(std::memory_order_relaxed))
+            count.store(idx + 1, std::memory_order_release);
+
+        return {idx, gen};
+    }
+
+    // Nullptr if the handle is stale
+    T* get(Handle<T> handle) const {
+        if (!handle || handle.index >= count.load(std::memory_order_acquire))
+            return nullptr;
+
+        const auto& e = entry(handle.index);
+        if (e.generation.load(std::memory_order_seq_cst) != handle.generation)
+            return nullptr;
+
+        return e.object.load(std::memory_order_acquire);
+    }
+
+    // Invalidates the handle right away, the object itself lives until the next collect()
+    void retire(Handle<T> handle) {
+        std::lock_guard lock{mutex};
+
+        if (!handle || handle.index >= count.load(std::memory_order_relaxed))
+            return;
+
+        auto& e = entry(handle.index);
+        if (e.generation.load(std::memory_order_relaxed) != handle.generation)
+            return;
+
+        e.generation.store(handle.generation + 1, std::memory_order_seq_cst);
+        totalBytes.fetch_sub(e.bytes, std::memory_order_relaxed);
+        retired.emplace_back(handle.index, e.object.exchange(nullptr, std::memory_order_relaxed));
+    }
+
+    // Recycles entries of retired objects and hands dispose a task destroying each of them,
+    // unless a reader is pinned
+    template<typename Dispose>
+    std::size_t collect(const std::atomic<int>& pins, Dispose&& dispose) {
+        std::vector<Retired> garbage;
+        void (*destroyFunc)(T*) = nullptr;
+        {
+            std::lock_guard lock{mutex};
+            if (retired.empty() || pins.load(std::memory_order_seq_cst) != 0)
+                return 0;
+
+            garbage.swap(retired);
+            destroyFunc = destroy;
+            for (const auto& r : garbage)
+                freeList.push_back(r.index);
+        }
+
+        for (auto& r : garbage)
+            dispose(Task{[destroyFunc, obj = r.object]() { destroyFunc(obj); }});
+
+        return garbage.size();
+    }
+
+    // Accounted size of the live objects
+    std::size_t bytes() const { return totalBytes.load(std::memory_order_relaxed); }
+
+    ~ResourcePool() {
+        for (std::uint32_t i = 0; i < count.load(std::memory_order_relaxed); ++i)
+            if (auto obj = entry(i).object.load(std::memory_order_relaxed))
+                destroy(obj);
+
+        for (auto& r : retired)
+            destroy(r.object);
+    }
+
+private:
+    static constexpr std::uint32_t ChunkSize = 256;
+    static constexpr std::uint32_t MaxChunks = 1024;
+
+    struct Entry {
+        std::atomic<T*>            object     = nullptr;
+        std::atomic<std::uint32_t> generation = 0;
+        std::size_t                bytes      = 0; // Guarded by the pool mutex
+    };
+
+    struct Retired {
+        std::uint32_t index;
+        T*            object;
+    };
+
+    Entry& entry(std::uint32_t idx) const { return chunks[idx / ChunkSize][idx % ChunkSize]; }
+
+    std::array<std::unique_ptr<Entry[]>, MaxChunks> chunks;
+    std::atomic<std::uint32_t>                      count      = 0;
+    std::atomic<std::size_t>                        totalBytes = 0;
+
+    std::mutex                 mutex;
+    std::vector<std::uint32_t> freeList;
+    std::vector<Retired>       retired;
+    void (*destroy)(T*) = nullptr;
+};
+
+// Metadata of a published resource, the object itself is reached through the handle. Evicted
+// versions keep their metadata with an empty handle and are rebuilt from source on demand.
 template<typename ResType>
 struct Resource {
-    std::string     name;
-    HashResult      nameHash;
-    HashResult      hash;
-    Shared<ResType> resource;
+    std::string                        name;
+    HashResult                         nameHash = 0;
+    HashResult                         hash     = 0;
+    Handle<ResType>                    handle;
+    std::shared_ptr<const std::string> source;       // What it was built from, may be null
+    std::size_t                        bytes    = 0; // Object only, sources count separately
+    std::uint64_t                      lastUsed = 0; // Registry tick when it was last current
 };
 
-template<class ResType>
-Resource(std::string, HashResult, HashResult, Unique<ResType>&&) -> Resource<ResType>;
+// Current version of a named resource. Slots are created on first use and never move or go
+// away, so readers can keep a pointer to one and poll its version without touching the
+// registry. The version is 0 until something is published.
+template<typename T>
+class ResourceSlot {
+public:
+    ResourceSlot() = default;
+
+    ResourceSlot(const ResourceSlot&)            = delete;
+    ResourceSlot& operator=(const ResourceSlot&) = delete;
+
+    std::uint64_t version() const { return ver.load(std::memory_order_acquire); }
+
+    std::optional<Resource<T>> get() const {
+        std::lock_guard lock{mutex};
+        if (ver.load(std::memory_order_relaxed) == 0)
+            return std::nullopt;
+
+        return current;
+    }
+
+    // Copies the resource out only if it changed since seenVersion, which is then updated.
+    // When nothing changed this is a single atomic load.
+    bool fetch(std::uint64_t& seenVersion, Resource<T>& out) const {
+        if (version() == seenVersion)
+            return false;
+
+        std::lock_guard lock{mutex};
+        seenVersion = ver.load(std::memory_order_relaxed);
+        out         = current;
+        return true;
+    }
+
+    bool holds(HashResult hash) const {
+        std::lock_guard lock{mutex};
+        return ver.load(std::memory_order_relaxed) != 0 && current.hash == hash;
+    }
+
+    // Keeps up to historyDepth replaced versions around, most recent first. Returns the handle
+    // of the version that is no longer referenced, if any.
+    Handle<T> publish(Resource<T>&& res, std::size_t historyDepth = 0, std::uint64_t tick = 0) {
+        std::lock_guard lock{mutex};
+
+        Handle<T> evicted;
+        if (ver.load(std::memory_order_relaxed) != 0) {
+            // Going back to a version we already have, drop the older copy
+            auto dup = std::find_if(history.begin(), history.end(), [&](const Resource<T>& r) {
+                return r.hash == res.hash;
+            });
+
+            if (dup != history.end()) {
+                evicted = dup->handle;
+                history.erase(dup);
+            }
+
+            current.lastUsed = tick;
+            history.push_front(std::move(current));
+            if (history.size() > historyDepth) {
+                evicted = history.back().handle;
+                history.pop_back();
+            }
+        }
+
+        current = std::move(res);
+        ver.fetch_add(1, std::memory_order_release);
+        return evicted;
+    }
+
+    // Swaps the current and the most recent previous version. False if there is nothing to
+    // switch to or it was evicted, restore() it first.
+    bool flip(std::uint64_t tick) {
+        std::lock_guard lock{mutex};
+        if (history.empty() || !history.front().handle)
+            return false;
+
+        auto& prev = history.front();
+
+        current.lastUsed = tick;
+        std::swap(current, prev);
+        ver.fetch_add(1, std::memory_order_release);
+        return true;
+    }
+
+    // Makes the previous version with this hash current, the current one becomes the most
+    // recent previous. False if there is no such version or it was evicted.
+    bool select(HashResult hash, std::uint64_t tick) {
+        std::lock_guard lock{mutex};
+
+        auto it = std::find_if(history.begin(), history.end(), [&](const Resource<T>& r) {
+            return r.hash == hash;
+        });
+        if (it == history.end() || !it->handle)
+            return false;
+
+        auto selected = std::move(*it);
+        history.erase(it);
+
+        current.lastUsed = tick;
+        history.push_front(std::exchange(current, std::move(selected)));
+        ver.fetch_add(1, std::memory_order_release);
+        return true;
+    }
+
+    // Gives the evicted previous version with this hash its object back. False if there is no
+    // such version anymore or it already has one.
+    bool restore(HashResult hash, Handle<T> handle) {
+        std::lock_guard lock{mutex};
+
+        for (auto& r : history) {
+            if (r.hash == hash && !r.handle) {
+                r.handle = handle;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // Tick of the least recently current version still holding an object, max if none
+    std::uint64_t oldestUse() const {
+        std::lock_guard lock{mutex};
+
+        auto oldest = std::numeric_limits<std::uint64_t>::max();
+        for (const auto& r : history)
+            if (r.handle)
+                oldest = std::min(oldest, r.lastUsed);
+
+        return oldest;
+    }
+
+    // Drops the object of the previous version last current at tick, keeping its metadata
+    Handle<T> evict(std::uint64_t tick) {
+        std::lock_guard lock{mutex};
+
+        for (auto& r : history)
+            if (r.handle && r.lastUsed == tick)
+                return std::exchange(r.handle, {});
+
+        return {};
+    }
+
+    // Replaced versions still alive, most recent first
+    std::vector<Resource<T>> previous() const {
+        std::lock_guard lock{mutex};
+        return {history.begin(), history.end()};
+    }
+
+private:
+    Resource<T>                current;
+    std::deque<Resource<T>>    history;
+    std::atomic<std::uint64_t> ver = 0;
+    mutable std::mutex         mutex;
+};
 
 template<typename T>
-using ResourceMap = Map<HashResult, Resource<T>>;
+using ResourceMap = Map<HashResult, std::unique_ptr<ResourceSlot<T>>>;
 
 class ResourceRegistry {
 public:
+    // Replaced programs kept alive for A/B comparisons, other resources are retired right away
     template<typename T>
-    void addResource(Resource<T> res) {
-        if constexpr (std::is_same_v<Shader, T>)
-            return addResource(std::move(res), shaders);
-        else if constexpr (std::is_same_v<Program, T>)
-            return addResource(std::move(res), programs);
-        else if constexpr (std::is_same_v<Texture, T>)
-            return addResource(std::move(res), textures);
+    static constexpr std::size_t HistoryDepth = std::is_same_v<T, Program> ? 4 : 0;
+
+    // Keeps objects resolved from handles alive, collectGarbage() won't destroy anything while
+    // a pin is held. Threads other than the collecting one must hold one while dereferencing.
+    class ReadPin {
+    public:
+        explicit ReadPin(const ResourceRegistry& reg) : pins(&reg.pins) {
+            pins->fetch_add(1, std::memory_order_seq_cst);
+        }
+        ~ReadPin() { pins->fetch_sub(1, std::memory_order_release); }
+
+        ReadPin(const ReadPin&)            = delete;
+        ReadPin& operator=(const ReadPin&) = delete;
+
+    private:
+        std::atomic<int>* pins;
+    };
+
+    ReadPin pin() const { return ReadPin{*this}; }
+
+    template<typename T>
+    using Reloader = std::function<Unique<T>(const Resource<T>&)>;
+
+    // Stores the object and publishes it under nameHash, retiring the version it replaces.
+    // Call where T's memorySize() is valid, for GL objects that's a thread with a context.
+    template<typename T>
+    Resource<T> addResource(
+        const std::string& name, HashResult nameHash, HashResult hash, Unique<T>&& object,
+        std::shared_ptr<const std::string> source = nullptr) {
+        auto& resPool = pool<T>();
+
+        const auto bytes = object->memorySize();
+        trackSource(source);
+
+        Resource<T> res{name, nameHash, hash, {}, std::move(source), bytes};
+        res.handle = resPool.insert(std::move(object), bytes);
+
+        if (auto prev = slot<T>(nameHash).publish(Resource<T>{res}, HistoryDepth<T>, tick()))
+            resPool.retire(prev);
+
+        return res;
+    }
+
+    // Makes the previous version of the resource current and the current one previous. An
+    // evicted previous version has to be reloaded and restored first.
+    template<typename T>
+    bool flip(HashResult nameHash) {
+        auto pSlot = findSlot(nameHash, map<T>());
+        return pSlot && pSlot->flip(tick());
+    }
+
+    // Makes the previous version with this hash current, whatever was published since
+    template<typename T>
+    bool select(HashResult nameHash, HashResult hash) {
+        auto pSlot = findSlot(nameHash, map<T>());
+        return pSlot && pSlot->select(hash, tick());
+    }
+
+    // Rebuilds evicted versions of T from their metadata when they are needed again
+    template<typename T>
+    void setReloader(Reloader<T>&& func) {
+        reloader<T>() = std::move(func);
+    }
+
+    // Runs the reloader, on any thread where T can be created. Null if it failed or there's none.
+    template<typename T>
+    Unique<T> reload(const Resource<T>& version) const {
+        const auto& reloadFunc = const_cast<ResourceRegistry*>(this)->reloader<T>();
+        return reloadFunc ? reloadFunc(version) : nullptr;
+    }
+
+    // Hands a reloaded object back to its evicted version. False, and the object is retired, if
+    // that version is gone or was restored meanwhile.
+    template<typename T>
+    bool restore(const Resource<T>& version, Unique<T>&& object) {
+        auto& resPool = pool<T>();
+        auto  handle  = resPool.insert(std::move(object), version.bytes);
+
+        auto pSlot = findSlot(version.nameHash, map<T>());
+        if (pSlot && pSlot->restore(version.hash, handle))
+            return true;
+
+        resPool.retire(handle);
+        return false;
+    }
+
+    void setMemoryBudget(std::size_t bytes) { budget.store(bytes, std::memory_order_relaxed); }
+
+    // Bytes held by live objects of every type and by the sources they were built from
+    std::size_t memoryUsage() const {
+        return shaderPool.bytes() + programPool.bytes() + texturePool.bytes() + sourceBytes();
+    }
+
+    template<typename T>
+    T* get(Handle<T> handle) const {
+        return pool<T>().get(handle);
     }
 
     template<typename T>
@@ -76,41 +476,189 @@ public:
 
     template<typename T>
     std::optional<Resource<T>> getResource(HashResult hash) const {
+        auto pSlot = findSlot(hash, map<T>());
+        return pSlot ? pSlot->get() : std::nullopt;
+    }
+
+    template<typename T>
+    bool exists(HashResult nameHash, HashResult hash) const {
+        auto pSlot = findSlot(nameHash, map<T>());
+        return pSlot && pSlot->holds(hash);
+    }
+
+    // Stable slot for nameHash, created empty if nothing was published under it yet
+    template<typename T>
+    ResourceSlot<T>& slot(HashResult nameHash) {
+        auto& resMap = map<T>();
+
+        std::lock_guard lock{resMap.mutex};
+        auto& pSlot = resMap.map[nameHash];
+        if (!pSlot)
+            pSlot = std::make_unique<ResourceSlot<T>>();
+
+        return *pSlot;
+    }
+
+    // Hands replaced resources nobody can reach anymore to dispose(Task&&), which decides when
+    // and where they are destroyed. Called once per frame by the thread owning the GL context.
+    // Versions that aren't current are evicted, least recently used first, while over budget.
+    template<typename Dispose>
+    std::size_t collectGarbage(Dispose&& dispose) {
+        enforceBudget();
+
+        return shaderPool.collect(pins, dispose) + programPool.collect(pins, dispose) +
+               texturePool.collect(pins, dispose);
+    }
+
+private:
+    std::uint64_t tick() { return useClock.fetch_add(1, std::memory_order_relaxed) + 1; }
+
+    // A shader and the programs linked from it share one source. Each source is counted once,
+    // for as long as any version, evicted or not, or anyone else still holds it.
+    void trackSource(const std::shared_ptr<const std::string>& source) {
+        if (!source)
+            return;
+
+        std::lock_guard lock{sourcesMutex};
+        pruneSources();
+
+        const auto same = [&](const CountedSource& counted) {
+            return !counted.source.owner_before(source) && !source.owner_before(counted.source);
+        };
+        if (!std::ranges::any_of(countedSources, same))
+            countedSources.push_back({source, source->size()});
+    }
+
+    std::size_t sourceBytes() const {
+        std::lock_guard lock{sourcesMutex};
+        pruneSources();
+
+        std::size_t bytes = 0;
+        for (const auto& counted : countedSources)
+            bytes += counted.bytes;
+        return bytes;
+    }
+
+    // The last holder of a source going away releases its bytes
+    void pruneSources() const {
+        std::erase_if(countedSources, [](const auto& counted) { return counted.source.expired(); });
+    }
+
+    void enforceBudget() {
+        while (memoryUsage() > budget.load(std::memory_order_relaxed)) {
+            const auto oldest =
+                std::min({oldestUse<Shader>(), oldestUse<Program>(), oldestUse<Texture>()});
+            if (!evict<Shader>(oldest) && !evict<Program>(oldest) && !evict<Texture>(oldest))
+                return; // Everything left is current
+        }
+    }
+
+    template<typename T>
+    std::uint64_t oldestUse() const {
+        const auto& resMap = map<T>();
+        std::lock_guard lock{resMap.mutex};
+
+        auto oldest = std::numeric_limits<std::uint64_t>::max();
+        for (const auto& [hash, pSlot] : resMap.map)
+            oldest = std::min(oldest, pSlot->oldestUse());
+
+        return oldest;
+    }
+
+    template<typename T>
+    bool evict(std::uint64_t tick) {
+        auto& resMap = map<T>();
+        std::lock_guard lock{resMap.mutex};
+
+        for (auto& [hash, pSlot] : resMap.map) {
+            if (auto handle = pSlot->evict(tick)) {
+                pool<T>().retire(handle);
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    template<typename T>
+    Reloader<T>& reloader() {
         if constexpr (std::is_same_v<Shader, T>)
-            return getResource(hash, shaders);
+            return shaderReloader;
         else if constexpr (std::is_same_v<Program, T>)
-            return getResource(hash, programs);
+            return programReloader;
         else if constexpr (std::is_same_v<Texture, T>)
-            return getResource(hash, textures);
+            return textureReloader;
     }
 
     template<typename T>
-    bool exists(HashResult nameHash, HashResult hash) const {
-        const auto opt = getResource<T>(nameHash);
-        return opt && opt.value().hash == hash;
+    const ResourceSlot<T>* findSlot(HashResult hash, const ResourceMap<T>& resMap) const {
+        std::lock_guard lock{resMap.mutex};
+
+        auto it = resMap.map.find(hash);
+        return it != resMap.map.end() ? it->second.get() : nullptr;
     }
 
-private:
     template<typename T>
-    std::optional<Resource<T>> getResource(HashResult hash, const ResourceMap<T>& map) const {
-        std::lock_guard lock{map.mutex};
+    ResourceSlot<T>* findSlot(HashResult hash, ResourceMap<T>& resMap) {
+        std::lock_guard lock{resMap.mutex};
 
-        auto it = map.map.find(hash);
-        if (it != map.map.end())
-            return it->second;
+        auto it = resMap.map.find(hash);
+        return it != resMap.map.end() ? it->second.get() : nullptr;
+    }
 
-        return std::nullopt;
+    template<typename T>
+    ResourceMap<T>& map() {
+        if constexpr (std::is_same_v<Shader, T>)
+            return shaders;
+        else if constexpr (std::is_same_v<Program, T>)
+            return programs;
+        else if constexpr (std::is_same_v<Texture, T>)
+            return textures;
     }
 
     template<typename T>
-    void addResource(Resource<T> res, ResourceMap<T>& map) {
-        std::lock_guard reslock{map.mutex};
-        map.map[res.nameHash] = std::move(res);
+    const ResourceMap<T>& map() const {
+        return const_cast<ResourceRegistry*>(this)->map<T>();
+    }
+
+    template<typename T>
+    ResourcePool<T>& pool() {
+        if constexpr (std::is_same_v<Shader, T>)
+            return shaderPool;
+        else if constexpr (std::is_same_v<Program, T>)
+            return programPool;
+        else if constexpr (std::is_same_v<Texture, T>)
+            return texturePool;
+    }
+
+    template<typename T>
+    const ResourcePool<T>& pool() const {
+        return const_cast<ResourceRegistry*>(this)->pool<T>();
     }
 
     ResourceMap<Shader>  shaders;
     ResourceMap<Program> programs;
     ResourceMap<Texture> textures;
+
+    ResourcePool<Shader>  shaderPool;
+    ResourcePool<Program> programPool;
+    ResourcePool<Texture> texturePool;
+
+    Reloader<Shader>  shaderReloader;
+    Reloader<Program> programReloader;
+    Reloader<Texture> textureReloader;
+
+    struct CountedSource {
+        std::weak_ptr<const std::string> source;
+        std::size_t                      bytes;
+    };
+
+    mutable std::mutex                 sourcesMutex;
+    mutable std::vector<CountedSource> countedSources;
+
+    std::atomic<std::size_t>   budget   = std::numeric_limits<std::size_t>::max();
+    std::atomic<std::uint64_t> useClock = 0;
+    mutable std::atomic<int>   pins     = 0;
 };
 
 } // namespace sdbox
@@ -0,0 +1,188 @@
+#ifndef SDBOX_ASYNC_H
+#define SDBOX_ASYNC_H
+
+#include <sdbox.h>
+#include <thread.h>
+#include <util.h>
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+
+namespace sdbox {
+
+template<typename T = void>
+class Async;
+
+namespace detail {
+
+struct FinalAwaiter {
+    bool await_ready() const noexcept { return false; }
+
+    template<typename Promise>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+        auto& promise = handle.promise();
+        if (promise.continuation)
+            return promise.continuation;
+
+        // Nobody is waiting on a detached coroutine, it owns itself
+        if (promise.detached)
+            handle.destroy();
+
+        return std::noop_coroutine();
+    }
+
+    void await_resume() const noexcept {}
+};
+
+struct PromiseBase {
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+    FinalAwaiter        final_suspend() const noexcept { return {}; }
+
+    void unhandled_exception() {
+        if (!detached) {
+            exception = std::current_exception();
+            return;
+        }
+
+        try {
+            std::rethrow_exception(std::current_exception());
+        } catch (const std::exception& ex) {
+            FATAL("Unhandled exception in detached coroutine: {}", ex.what());
+        }
+    }
+
+    std::coroutine_handle<> continuation = nullptr;
+    std::exception_ptr      exception    = nullptr;
+    bool                    detached     = false;
+};
+
+template<typename T>
+struct PromiseResult {
+    void return_value(T val) { value.emplace(std::move(val)); }
+    T    take() { return std::move(*value); }
+
+    std::optional<T> value;
+};
+
+template<>
+struct PromiseResult<void> {
+    void return_void() const {}
+    void take() const {}
+};
+
+} // namespace detail
+
+// ------------------------------------------------------------------
+//      Async
+// ------------------------------------------------------------------
+// Lazily started coroutine. Starts when awaited, resuming the awaiting coroutine once done,
+// or when detached with Spawn(), in which case it destroys itself at the end.
+template<typename T>
+class Async {
+public:
+    struct promise_type : detail::PromiseBase, detail::PromiseResult<T> {
+        Async get_return_object() { return Async{Handle::from_promise(*this)}; }
+    };
+
+    using Handle = std::coroutine_handle<promise_type>;
+
+    Async(Async&& rhs) noexcept : handle(std::exchange(rhs.handle, nullptr)) {}
+    Async& operator=(Async&& rhs) noexcept {
+        if (this != &rhs) {
+            if (handle)
+                handle.destroy();
+            handle = std::exchange(rhs.handle, nullptr);
+        }
+        return *this;
+    }
+
+    Async(const Async&)            = delete;
+    Async& operator=(const Async&) = delete;
+
+    ~Async() {
+        if (handle)
+            handle.destroy();
+    }
+
+    bool await_ready() const noexcept { return false; }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        handle.promise().continuation = awaiting;
+        return handle;
+    }
+
+    T await_resume() {
+        auto& promise = handle.promise();
+        if (promise.exception)
+            std::rethrow_exception(promise.exception);
+
+        return promise.take();
+    }
+
+    void detach() && {
+        auto h               = std::exchange(handle, nullptr);
+        h.promise().detached = true;
+        h.resume();
+    }
+
+private:
+    explicit Async(Handle handle) : handle(handle) {}
+
+    Handle handle = nullptr;
+};
+
+// Fire and forget
+inline void Spawn(Async<void>&& task) {
+    std::move(task).detach();
+}
+
+// ------------------------------------------------------------------
+//      Awaiters
+// ------------------------------------------------------------------
+// Resumes the coroutine on one of the pool's workers
+inline auto ScheduleOn(ThreadPool& pool) {
+    struct Awaiter {
+        ThreadPool& pool;
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle) {
+            pool.submit([handle]() { handle.resume(); });
+        }
+        void await_resume() const noexcept {}
+    };
+
+    return Awaiter{pool};
+}
+
+// Runs func on the pool and resumes the coroutine on that worker with its result
+template<typename F>
+auto RunOn(ThreadPool& pool, F&& func) {
+    using Result = std::invoke_result_t<F&>;
+
+    struct Awaiter {
+        ThreadPool&           pool;
+        std::decay_t<F>       func;
+        std::optional<Result> result;
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle) {
+            pool.submit([this, handle]() {
+                result.emplace(func());
+                handle.resume();
+            });
+        }
+        Result await_resume() { return std::move(*result); }
+    };
+
+    return Awaiter{pool, std::forward<F>(func), std::nullopt};
+}
+
+// Resumes once the file has been read on one of the pool's workers
+inline auto ReadTextFileAsync(ThreadPool& pool, const fs::path& filePath) {
+    return RunOn(pool, [filePath]() { return util::ReadTextFile(filePath); });
+}
+
+} // namespace sdbox
+
+#endif
\ No newline at end of file
@@ -1,11 +1,18 @@
 #include <image.h>
+#include <thread.h>
 
+#include <bit>
 #include <cstring>
+#include <fstream>
 
 using namespace sdbox;
 
 namespace {
 
+std::size_t RowGrain(int width) {
+    return std::max<std::size_t>(1, MinItemsPerTask / std::max(width, 1));
+}
+
 float EncodeU8(std::uint8_t u8) {
     return u8 / 255.0f;
 }
@@ -121,11 +128,18 @@ void Image::setPixel(const PixelVal& px, int x, int y, int z, int lvl) {
 
 void Image::fill(PixelVal val) {
     for (int lvl = 0; lvl < levels; ++lvl) {
-        const auto lvlFmt = format(lvl);
-        for (int z = 0; z < lvlFmt.depth; ++z)
-            for (int y = 0; y < lvlFmt.height; ++y)
+        const auto lvlFmt  = format(lvl);
+        const auto numRows = static_cast<std::size_t>(lvlFmt.depth) * lvlFmt.height;
+
+        // Rows of every slice, in parallel
+        ParallelFor(0, numRows, RowGrain(lvlFmt.width), [&](std::size_t begin, std::size_t end) {
+            for (auto row = begin; row < end; ++row) {
+                const int z = row / lvlFmt.height;
+                const int y = row % lvlFmt.height;
                 for (int x = 0; x < lvlFmt.width; ++x)
                     setPixel(val, x, y, z, lvl);
+            }
+        });
     }
 }
 
@@ -138,14 +152,21 @@ void Image::copy(Extents ext, const Image& srcImg, int toLvl, int fromLvl) {
     const auto toX = ext.toX, toY = ext.toY, toZ = ext.toZ;
     const auto fromX = ext.fromX, fromY = ext.fromY, fromZ = ext.fromZ;
 
-    for (int z = 0; z < ext.sizeZ; ++z) {
-        for (int y = 0; y < ext.sizeY; ++y) {
+    if (ext.sizeY <= 0 || ext.sizeZ <= 0)
+        return;
+
+    const auto numRows = static_cast<std::size_t>(ext.sizeZ) * ext.sizeY;
+
+    ParallelFor(0, numRows, RowGrain(ext.sizeX), [&](std::size_t begin, std::size_t end) {
+        for (auto row = begin; row < end; ++row) {
+            const int z = row / ext.sizeY;
+            const int y = row % ext.sizeY;
             for (int x = 0; x < ext.sizeX; ++x) {
                 const auto& px = srcImg.pixel(fromX + x, fromY + y, fromZ + z, fromLvl);
                 setPixel(px, toX + x, toY + y, toZ + z, toLvl);
             }
         }
-    }
+    });
 }
 
 Image Image::convertTo(ImageFormat newFmt, int nLvls) const {
@@ -232,16 +253,19 @@ void Image::flipY() {
     Image flipImg{format(), levels};
 
     for (int lvl = 0; lvl < levels; ++lvl) {
-        const auto lvlFmt = format(lvl);
+        const auto lvlFmt  = format(lvl);
+        const auto numRows = static_cast<std::size_t>(lvlFmt.depth) * lvlFmt.height;
 
-        for (int z = 0; z < lvlFmt.depth; ++z) {
-            for (int y = 0; y < lvlFmt.height; ++y) {
+        ParallelFor(0, numRows, RowGrain(lvlFmt.width), [&](std::size_t begin, std::size_t end) {
+            for (auto row = begin; row < end; ++row) {
+                const int z = row / lvlFmt.height;
+                const int y = row % lvlFmt.height;
                 for (int x = 0; x < lvlFmt.width; ++x) {
                     auto px = pixel(x, lvlFmt.height - 1 - y, z, lvl);
                     flipImg.setPixel(px, x, y, z, lvl);
                 }
             }
-        }
+        });
     }
 
     *this = std::move(flipImg);
@@ -270,13 +294,17 @@ std::unique_ptr<std::byte[]> sdbox::ExtractChannel(const Image& image, int c, in
 
     auto channel = std::make_unique<std::byte[]>(chSize);
 
-    auto imgPtr = image.data(lvl);
-    auto dstPtr = channel.get();
+    const auto srcBase = image.data(lvl) + compSize * c;
+    const auto dstBase = channel.get();
 
     const auto strideCh = compSize * imgFmt.nChannels;
 
-    for (int p = 0; p < nPixels; ++p, imgPtr += strideCh, dstPtr += compSize)
-        std::memcpy(dstPtr, imgPtr + compSize * c, compSize);
+    ParallelFor(0, nPixels, MinItemsPerTask, [&](std::size_t begin, std::size_t end) {
+        auto imgPtr = srcBase + begin * strideCh;
+        auto dstPtr = dstBase + begin * compSize;
+        for (auto p = begin; p < end; ++p, imgPtr += strideCh, dstPtr += compSize)
+            std::memcpy(dstPtr, imgPtr, compSize);
+    });
 
     return channel;
 }
@@ -284,4 +312,68 @@ std::unique_ptr<std::byte[]> sdbox::ExtractChannel(const Image& image, int c, in
 std::unique_ptr<std::byte[]> sdbox::ExtractChannel(const ImageView imgView, int c, int lvl) {
     assert(imgView.numLevels() > lvl);
     return ExtractChannel(*imgView.image(), c, imgView.level() + lvl);
+}
+
+bool sdbox::WritePPM(
+    const std::filesystem::path& filePath, ImageFormat fmt, const std::byte* pixels) {
+    DCHECK(fmt.pFmt == PixelFormat::U8 && fmt.nChannels >= 3);
+
+    std::ofstream file(filePath, std::ios_base::binary | std::ios_base::out);
+    if (file.fail()) {
+        LOG_ERROR("Failed to open file {}. {}", filePath.string(), std::strerror(errno));
+        return false;
+    }
+
+    file << std::format("P6\n{} {}\n255\n", fmt.width, fmt.height);
+
+    const auto srcStride = static_cast<std::size_t>(fmt.width) * fmt.nChannels;
+    const auto dstStride = static_cast<std::size_t>(fmt.width) * 3;
+
+    std::vector<std::byte> row(dstStride);
+    for (int y = fmt.height - 1; y >= 0; --y) {
+        const auto src = pixels + y * srcStride;
+        for (int x = 0; x < fmt.width; ++x)
+            std::memcpy(&row[x * 3], src + x * fmt.nChannels, 3);
+
+        file.write(reinterpret_cast<const char*>(row.data()), dstStride);
+    }
+
+    if (file.fail()) {
+        LOG_ERROR("Failed to write file {}.", filePath.string());
+        return false;
+    }
+
+    return true;
+}
+
+bool sdbox::WritePFM(
+    const std::filesystem::path& filePath, ImageFormat fmt, const float* pixels, float scale) {
+    DCHECK(fmt.pFmt == PixelFormat::F32 && fmt.nChannels >= 3);
+    static_assert(std::endian::native == std::endian::little);
+
+    std::ofstream file(filePath, std::ios_base::binary | std::ios_base::out);
+    if (file.fail()) {
+        LOG_ERROR("Failed to open file {}. {}", filePath.string(), std::strerror(errno));
+        return false;
+    }
+
+    // Negative scale means little endian, rows go bottom to top like OpenGL's
+    file << std::format("PF\n{} {}\n-1.0\n", fmt.width, fmt.height);
+
+    std::vector<float> row(static_cast<std::size_t>(fmt.width) * 3);
+    for (int y = 0; y < fmt.height; ++y) {
+        const auto src = pixels + static_cast<std::size_t>(y) * fmt.width * fmt.nChannels;
+        for (int x = 0; x < fmt.width; ++x)
+            for (int c = 0; c < 3; ++c)
+                row[x * 3 + c] = src[x * fmt.nChannels + c] * scale;
+
+        file.write(reinterpret_cast<const char*>(row.data()), row.size() * sizeof(float));
+    }
+
+    if (file.fail()) {
+        LOG_ERROR("Failed to write file {}.", filePath.string());
+        return false;
+    }
+
+    return true;
 }
\ No newline at end of file
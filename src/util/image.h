@@ -149,6 +149,16 @@ private:
 std::unique_ptr<std::byte[]> ExtractChannel(const Image& image, int c, int lvl = 0);
 std::unique_ptr<std::byte[]> ExtractChannel(const ImageView imgView, int c, int lvl = 0);
 
+// Binary PPM from 8 bit RGB(A) pixels stored bottom row first, as OpenGL reads them back.
+// Alpha is dropped.
+bool WritePPM(const std::filesystem::path& filePath, ImageFormat fmt, const std::byte* pixels);
+
+// Little endian PFM from float RGB(A) pixels stored bottom row first, each scaled by scale.
+// Alpha is dropped.
+bool WritePFM(
+    const std::filesystem::path& filePath, ImageFormat fmt, const float* pixels,
+    float scale = 1.0f);
+
 } // namespace sdbox
 
 #endif
\ No newline at end of file
@@ -0,0 +1,188 @@
+#ifndef SDBOX_LOCKFREE_H
+#define SDBOX_LOCKFREE_H
+
+#include <sdbox.h>
+
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <type_traits>
+
+namespace sdbox {
+
+constexpr std::size_t CacheLineSize = 64;
+
+// Bounded single producer, single consumer queue. Capacity must be a power of two.
+// push() is only called from the producer thread and pop() from the consumer thread.
+template<typename T, std::size_t Capacity>
+class SpscQueue {
+    static_assert(Capacity > 1 && (Capacity & (Capacity - 1)) == 0);
+    static_assert(std::is_trivially_copyable_v<T>);
+
+public:
+    SpscQueue() = default;
+
+    SpscQueue(const SpscQueue&)            = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    bool push(const T& val) {
+        const auto t = tail.load(std::memory_order_relaxed);
+        if (t - headCache == Capacity) {
+            headCache = head.load(std::memory_order_acquire);
+            if (t - headCache == Capacity)
+                return false; // Full
+        }
+
+        slots[t & Mask] = val;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    std::optional<T> pop() {
+        const auto h = head.load(std::memory_order_relaxed);
+        if (h == tailCache) {
+            tailCache = tail.load(std::memory_order_acquire);
+            if (h == tailCache)
+                return std::nullopt; // Empty
+        }
+
+        T val = slots[h & Mask];
+        head.store(h + 1, std::memory_order_release);
+        return val;
+    }
+
+    bool empty() const {
+        return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+    }
+
+    static constexpr std::size_t capacity() { return Capacity; }
+
+private:
+    static constexpr std::size_t Mask = Capacity - 1;
+
+    // Consumer owned
+    alignas(CacheLineSize) std::atomic<std::size_t> head{0};
+    std::size_t tailCache = 0;
+
+    // Producer owned
+    alignas(CacheLineSize) std::atomic<std::size_t> tail{0};
+    std::size_t headCache = 0;
+
+    alignas(CacheLineSize) std::array<T, Capacity> slots;
+};
+
+// Chase-Lev work stealing deque. The owner thread pushes and pops at the bottom, any other
+// thread can steal from the top. Grows when full; retired arrays are kept alive until the
+// deque is destroyed, since a concurrent thief may still be reading from them.
+template<typename T>
+class WorkStealingDeque {
+    static_assert(std::is_trivially_copyable_v<T>);
+
+public:
+    explicit WorkStealingDeque(std::int64_t capacity = 256) {
+        DCHECK(capacity > 1 && (capacity & (capacity - 1)) == 0);
+        arrays.push_back(std::make_unique<Array>(capacity));
+        array.store(arrays.back().get(), std::memory_order_relaxed);
+    }
+
+    WorkStealingDeque(const WorkStealingDeque&)            = delete;
+    WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+    // Owner only
+    void push(T val) {
+        const auto b = bottom.load(std::memory_order_relaxed);
+        const auto t = top.load(std::memory_order_acquire);
+        auto*      a = array.load(std::memory_order_relaxed);
+
+        if (b - t > a->capacity - 1)
+            a = grow(a, b, t);
+
+        a->put(b, val);
+        bottom.store(b + 1, std::memory_order_release);
+    }
+
+    // Owner only
+    std::optional<T> pop() {
+        const auto b = bottom.load(std::memory_order_relaxed) - 1;
+        auto*      a = array.load(std::memory_order_relaxed);
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto t = top.load(std::memory_order_relaxed);
+
+        if (t > b) {
+            // Empty
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return std::nullopt;
+        }
+
+        std::optional<T> val = a->get(b);
+        if (t == b) {
+            // Last element, race against thieves
+            if (!top.compare_exchange_strong(
+                    t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                val = std::nullopt;
+
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+
+        return val;
+    }
+
+    // Any thread
+    std::optional<T> steal() {
+        auto t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const auto b = bottom.load(std::memory_order_acquire);
+
+        if (t >= b)
+            return std::nullopt;
+
+        auto* a   = array.load(std::memory_order_acquire);
+        T     val = a->get(t);
+        if (!top.compare_exchange_strong(
+                t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            return std::nullopt; // Lost the race
+
+        return val;
+    }
+
+    bool empty() const {
+        const auto b = bottom.load(std::memory_order_relaxed);
+        const auto t = top.load(std::memory_order_relaxed);
+        return b <= t;
+    }
+
+private:
+    struct Array {
+        explicit Array(std::int64_t cap)
+            : capacity(cap), mask(cap - 1), slots(std::make_unique<std::atomic<T>[]>(cap)) {}
+
+        T    get(std::int64_t i) const { return slots[i & mask].load(std::memory_order_relaxed); }
+        void put(std::int64_t i, T val) { slots[i & mask].store(val, std::memory_order_relaxed); }
+
+        std::int64_t                    capacity;
+        std::int64_t                    mask;
+        std::unique_ptr<std::atomic<T>[]> slots;
+    };
+
+    Array* grow(Array* old, std::int64_t b, std::int64_t t) {
+        auto bigger = std::make_unique<Array>(old->capacity * 2);
+        for (auto i = t; i < b; ++i)
+            bigger->put(i, old->get(i));
+
+        arrays.push_back(std::move(bigger));
+        array.store(arrays.back().get(), std::memory_order_release);
+        return arrays.back().get();
+    }
+
+    alignas(CacheLineSize) std::atomic<std::int64_t> top{0};
+    alignas(CacheLineSize) std::atomic<std::int64_t> bottom{0};
+    alignas(CacheLineSize) std::atomic<Array*> array{nullptr};
+
+    // Owner only
+    std::vector<std::unique_ptr<Array>> arrays;
+};
+
+} // namespace sdbox
+
+#endif
\ No newline at end of file
@@ -0,0 +1,79 @@
+#include <taskgraph.h>
+
+using namespace sdbox;
+
+TaskGraph::NodeId TaskGraph::addNode(
+    Task&& func, std::span<const NodeId> deps, Affinity affinity,
+    std::unique_ptr<ResultBase> result) {
+    DCHECK(!launched);
+
+    const auto id = nodes.size();
+
+    auto node      = std::make_unique<NodeData>();
+    node->func     = std::move(func);
+    node->affinity = affinity;
+    node->result   = std::move(result);
+    node->pending.store(deps.size(), std::memory_order_relaxed);
+
+    for (auto dep : deps) {
+        DCHECK_LT(dep, id); // Dependencies must already exist, so no cycles are possible
+        nodes[dep]->successors.push_back(id);
+    }
+
+    nodes.push_back(std::move(node));
+    return id;
+}
+
+void TaskGraph::schedule(NodeId id) {
+    auto& pool = nodes[id]->affinity == Affinity::GLContext ? gl : cpu;
+    if (continuation)
+        pool.submit([this, id]() { execute(id); });
+    else
+        pool.submit(latch, [this, id]() { execute(id); });
+}
+
+void TaskGraph::execute(NodeId id) {
+    auto& node = *nodes[id];
+
+    // Cancelled nodes are skipped but still release their successors, so the graph drains
+    if (!token.cancelled())
+        node.func();
+
+    node.func.reset();
+
+    for (auto succ : node.successors)
+        if (nodes[succ]->pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            schedule(succ);
+
+    // The awaiting coroutine may destroy the graph, nothing touches it past the last node
+    if (continuation && remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        continuation.resume();
+}
+
+void TaskGraph::run() {
+    DCHECK(!launched);
+    launched = true;
+
+    for (NodeId id = 0; id < nodes.size(); ++id)
+        if (nodes[id]->pending.load(std::memory_order_relaxed) == 0)
+            schedule(id);
+
+    // Only helps with CPU tasks, GL nodes stay on threads owning a context
+    cpu.wait(latch);
+}
+
+void TaskGraph::launch(std::coroutine_handle<> handle) {
+    DCHECK(!launched);
+    launched     = true;
+    continuation = handle;
+    remaining.store(nodes.size(), std::memory_order_relaxed);
+
+    // Roots are gathered first, the graph may be gone once the last one is scheduled
+    std::vector<NodeId> roots;
+    for (NodeId id = 0; id < nodes.size(); ++id)
+        if (nodes[id]->pending.load(std::memory_order_relaxed) == 0)
+            roots.push_back(id);
+
+    for (auto id : roots)
+        schedule(id);
+}
\ No newline at end of file
@@ -0,0 +1,125 @@
+#ifndef SDBOX_TASKGRAPH_H
+#define SDBOX_TASKGRAPH_H
+
+#include <sdbox.h>
+#include <thread.h>
+
+#include <coroutine>
+#include <optional>
+#include <span>
+
+namespace sdbox {
+
+// Where a node is allowed to run
+enum class Affinity { Any, GLContext };
+
+// Directed acyclic graph of tasks executed on a ThreadPool. Nodes start once all of their
+// dependencies finished (fan-in) and a node finishing releases all of its successors at once
+// (fan-out). Nodes with GLContext affinity go to the pool whose threads own a shared context.
+class TaskGraph {
+public:
+    using NodeId = std::size_t;
+
+    // Typed handle to a node, result is available to successors and after run()
+    template<typename T>
+    struct Node {
+        NodeId id;
+        operator NodeId() const { return id; }
+    };
+
+    TaskGraph(ThreadPool& cpuPool, ThreadPool& glPool, CancelToken token = {})
+        : cpu(cpuPool), gl(glPool), token(token) {}
+
+    TaskGraph(const TaskGraph&)            = delete;
+    TaskGraph& operator=(const TaskGraph&) = delete;
+
+    template<typename F>
+    auto add(F&& func, std::span<const NodeId> deps, Affinity affinity = Affinity::Any) {
+        using T = std::invoke_result_t<F&>;
+
+        if constexpr (std::is_void_v<T>) {
+            auto id = addNode(Task{std::forward<F>(func)}, deps, affinity, nullptr);
+            return Node<T>{id};
+        } else {
+            auto result = std::make_unique<Result<T>>();
+            auto task   = Task{[func = std::forward<F>(func), res = result.get()]() mutable {
+                res->value.emplace(func());
+            }};
+
+            auto id = addNode(std::move(task), deps, affinity, std::move(result));
+            return Node<T>{id};
+        }
+    }
+
+    template<typename F>
+    auto add(F&& func, std::initializer_list<NodeId> deps = {}, Affinity affinity = Affinity::Any) {
+        return add(std::forward<F>(func), std::span{deps.begin(), deps.size()}, affinity);
+    }
+
+    // Empty if the node was skipped because the graph got cancelled
+    template<typename T>
+    std::optional<T>& get(Node<T> node) {
+        return static_cast<Result<T>&>(*nodes[node.id]->result).value;
+    }
+
+    // Launches every root and helps running tasks until the whole graph is done
+    void run();
+
+    // Launches every root without blocking, the awaiting coroutine resumes on the thread that
+    // finished the last node. Either this or run(), once.
+    auto runAsync() {
+        struct Awaiter {
+            TaskGraph& graph;
+
+            bool await_ready() const noexcept { return graph.nodes.empty(); }
+            void await_suspend(std::coroutine_handle<> handle) { graph.launch(handle); }
+            void await_resume() const noexcept {}
+        };
+
+        return Awaiter{*this};
+    }
+
+    std::size_t size() const { return nodes.size(); }
+
+private:
+    struct ResultBase {
+        virtual ~ResultBase() = default;
+    };
+
+    template<typename T>
+    struct Result : ResultBase {
+        std::optional<T> value;
+    };
+
+    struct NodeData {
+        Task                        func;
+        std::vector<NodeId>         successors;
+        std::atomic<int>            pending = 0;
+        Affinity                    affinity;
+        std::unique_ptr<ResultBase> result;
+    };
+
+    NodeId addNode(
+        Task&& func, std::span<const NodeId> deps, Affinity affinity,
+        std::unique_ptr<ResultBase> result);
+
+    void launch(std::coroutine_handle<> handle);
+    void schedule(NodeId id);
+    void execute(NodeId id);
+
+    ThreadPool& cpu;
+    ThreadPool& gl;
+    CancelToken token;
+    TaskLatch   latch;
+    bool        launched = false;
+
+    // Set when awaited, nodes not finished yet
+    std::coroutine_handle<>  continuation;
+    std::atomic<std::size_t> remaining = 0;
+
+    std::vector<std::unique_ptr<NodeData>> nodes;
+};
+
+} // namespace sdbox
+
+#endif
\ No newline at end of file
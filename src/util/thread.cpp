@@ -1,11 +1,33 @@
 #include <thread.h>
 
+#include <algorithm>
+
 using namespace sdbox;
 
 namespace {
 thread_local std::string ThreadName = "unnamed";
+
+// Pool and worker index the current thread belongs to, if any
+thread_local const ThreadPool* CurrentPool   = nullptr;
+thread_local std::size_t       CurrentWorker = 0;
+
+constexpr int SpinTries = 64;
+
+std::atomic<ThreadPool*> GlobalPool = nullptr;
+
+constexpr std::uint64_t PackHead(std::uint64_t tag, std::uint32_t idx) {
+    return (tag << 32) | idx;
 }
 
+constexpr std::uint32_t HeadIndex(std::uint64_t head) {
+    return static_cast<std::uint32_t>(head);
+}
+
+constexpr std::uint64_t HeadTag(std::uint64_t head) {
+    return head >> 32;
+}
+} // namespace
+
 void sdbox::SetThreadName(const std::string& name) {
     ThreadName = name;
 }
@@ -14,43 +36,237 @@ const std::string& sdbox::GetThreadName() {
     return ThreadName;
 }
 
+void sdbox::SetGlobalThreadPool(ThreadPool* pool) {
+    GlobalPool.store(pool, std::memory_order_release);
+}
+
+ThreadPool* sdbox::GlobalThreadPool() {
+    return GlobalPool.load(std::memory_order_acquire);
+}
+
+ThreadPool::TaskSlot* ThreadPool::SlotAllocator::acquire() {
+    auto curr = head.load(std::memory_order_acquire);
+
+    while (true) {
+        const auto idx = HeadIndex(curr);
+        if (idx == NilSlot) {
+            grow();
+            curr = head.load(std::memory_order_acquire);
+            continue;
+        }
+
+        const auto next    = slot(idx).next.load(std::memory_order_relaxed);
+        const auto newHead = PackHead(HeadTag(curr) + 1, next);
+        if (head.compare_exchange_weak(
+                curr, newHead, std::memory_order_acquire, std::memory_order_acquire))
+            return &slot(idx);
+    }
+}
+
+void ThreadPool::SlotAllocator::release(TaskSlot* pSlot) {
+    auto curr = head.load(std::memory_order_relaxed);
+
+    while (true) {
+        pSlot->next.store(HeadIndex(curr), std::memory_order_relaxed);
+        const auto newHead = PackHead(HeadTag(curr) + 1, pSlot->index);
+        if (head.compare_exchange_weak(
+                curr, newHead, std::memory_order_release, std::memory_order_relaxed))
+            return;
+    }
+}
+
+void ThreadPool::SlotAllocator::grow() {
+    std::lock_guard lock{growMutex};
+
+    // Someone else refilled the list while we waited
+    if (HeadIndex(head.load(std::memory_order_acquire)) != NilSlot)
+        return;
+
+    const auto chunk = numChunks.load(std::memory_order_relaxed);
+    if (chunk == MaxChunks)
+        FATAL("Exceeded maximum number of in flight tasks ({}).", ChunkSize * MaxChunks);
+
+    chunks[chunk] = std::make_unique<TaskSlot[]>(ChunkSize);
+    numChunks.store(chunk + 1, std::memory_order_relaxed);
+
+    for (std::uint32_t i = 0; i < ChunkSize; ++i) {
+        auto& s = chunks[chunk][i];
+        s.index = chunk * ChunkSize + i;
+        release(&s);
+    }
+}
+
 ThreadPool::ThreadPool(std::size_t numThreads, InitThreadFunc&& initFunc) {
+    for (std::size_t i = 0; i < numThreads; ++i)
+        workers.push_back(std::make_unique<Worker>());
+
+    // Only start threads once every deque exists, workers steal from each other
+    for (std::size_t i = 0; i < numThreads; ++i) {
+        workers[i]->thread = std::thread([this, i, initFunc] {
+            workerLoop(i, initFunc);
+        });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    stopWorkers();
+}
+
+int ThreadPool::workerIndex() const {
+    return CurrentPool == this ? static_cast<int>(CurrentWorker) : -1;
+}
+
+void ThreadPool::push(Task&& task, TaskLatch* latch) {
+    DCHECK(!stop.load(std::memory_order_relaxed));
+
+    auto slot   = slots.acquire();
+    slot->task  = std::move(task);
+    slot->latch = latch;
+
+    if (CurrentPool == this) {
+        workers[CurrentWorker]->deque.push(slot);
+    } else {
+        std::lock_guard lock{injectMutex};
+        injectQueue.push_back(slot);
+        numInjected.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Pairs with the fence in workerLoop, either the sleeper sees the task or we see the sleeper
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (numSleeping.load(std::memory_order_relaxed) > 0) {
+        wakeEpoch.fetch_add(1, std::memory_order_release);
+        wakeEpoch.notify_one();
+    }
+}
+
+ThreadPool::TaskSlot* ThreadPool::popInjected(const TaskLatch* latch) {
+    if (numInjected.load(std::memory_order_relaxed) == 0)
+        return nullptr;
+
+    std::lock_guard lock{injectMutex};
+
+    // Oldest task, or oldest of the batch
+    auto it = latch ? std::find_if(
+                          injectQueue.begin(), injectQueue.end(),
+                          [latch](const TaskSlot* s) { return s->latch == latch; })
+                    : injectQueue.begin();
+    if (it == injectQueue.end())
+        return nullptr;
+
+    auto slot = *it;
+    injectQueue.erase(it);
+    numInjected.fetch_sub(1, std::memory_order_relaxed);
+
+    return slot;
+}
+
+ThreadPool::TaskSlot* ThreadPool::findTask(int idx) {
+    if (idx >= 0)
+        if (auto slot = workers[idx]->deque.pop())
+            return *slot;
+
+    if (auto slot = popInjected())
+        return slot;
+
+    // Try to steal, starting from the next worker so thieves spread out
+    const auto numThreads = workers.size();
+    const auto start      = idx >= 0 ? idx + 1 : 0;
     for (std::size_t i = 0; i < numThreads; ++i) {
-        workers.emplace_back([&, i, initFunc] {
-            if (initFunc)
-                initFunc(i);
+        const auto victim = (start + i) % numThreads;
+        if (static_cast<int>(victim) == idx)
+            continue;
+
+        if (auto slot = workers[victim]->deque.steal())
+            return *slot;
+    }
+
+    return nullptr;
+}
+
+void ThreadPool::run(TaskSlot* slot) {
+    auto latch = slot->latch;
+
+    slot->task();
+    slot->task.reset();
+    slots.release(slot);
+
+    if (latch)
+        latch->countDown();
+}
 
-            while (true) {
-                std::function<void()> task;
+void ThreadPool::wait(TaskLatch& latch) {
+    const auto idx = workerIndex();
 
-                {
-                    std::unique_lock lock{queueMutex};
+    while (!latch.done()) {
+        auto slot = idx >= 0 ? findTask(idx) : popInjected(&latch);
+        if (slot)
+            run(slot);
+        else
+            std::this_thread::yield();
+    }
+}
+
+CancelToken ThreadPool::supersede(std::uint64_t key) {
+    std::lock_guard lock{keysMutex};
 
-                    condition.wait(lock, [&] { return !tasks.empty() || stop; });
+    // Keys whose latest work finished, nothing can be cancelled through them anymore
+    std::erase_if(keySources, [](const auto& entry) { return !entry.second->referenced(); });
 
-                    if (tasks.empty() && stop)
-                        return;
+    auto& source = keySources[key];
+    if (!source)
+        source = std::make_unique<CancelSource>();
+
+    source->cancel();
+    return source->token();
+}
 
-                    task = std::move(tasks.front());
-                    tasks.pop();
+void ThreadPool::workerLoop(std::size_t idx, const InitThreadFunc& initFunc) {
+    CurrentPool   = this;
+    CurrentWorker = idx;
+
+    if (initFunc)
+        initFunc(idx);
+
+    while (true) {
+        TaskSlot* slot = nullptr;
+        for (int i = 0; i < SpinTries && !slot; ++i) {
+            slot = findTask(idx);
+            if (!slot)
+                std::this_thread::yield();
+        }
+
+        if (!slot) {
+            const auto epoch = wakeEpoch.load(std::memory_order_acquire);
+
+            numSleeping.fetch_add(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            slot = findTask(idx);
+            if (!slot) {
+                if (stop.load(std::memory_order_acquire)) {
+                    numSleeping.fetch_sub(1, std::memory_order_relaxed);
+                    return;
                 }
 
-                task();
-            };
-        });
+                wakeEpoch.wait(epoch, std::memory_order_acquire);
+            }
+
+            numSleeping.fetch_sub(1, std::memory_order_relaxed);
+        }
+
+        if (slot)
+            run(slot);
     }
 }
 
 void ThreadPool::stopWorkers() {
-    {
-        std::lock_guard lock{queueMutex};
-        if (stop)
-            return; // Threads already stopped and joined
+    if (stop.exchange(true))
+        return; // Threads already stopped and joined
 
-        stop = true;
-    }
+    wakeEpoch.fetch_add(1, std::memory_order_release);
+    wakeEpoch.notify_all();
 
-    condition.notify_all();
     for (auto& worker : workers)
-        worker.join();
+        if (worker->thread.joinable())
+            worker->thread.join();
 }
\ No newline at end of file
@@ -2,13 +2,16 @@
 #define SDBOX_THREAD_H
 
 #include <sdbox.h>
+#include <lockfree.h>
 
 #include <thread>
-#include <queue>
+#include <deque>
 #include <mutex>
 #include <functional>
+#include <memory>
 #include <condition_variable>
 #include <future>
+#include <unordered_map>
 
 namespace sdbox {
 
@@ -17,10 +20,183 @@ const std::string& GetThreadName();
 
 using InitThreadFunc = std::function<void(std::size_t)>;
 
+inline std::size_t DefaultNumThreads() {
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// ------------------------------------------------------------------
+//      Task
+// ------------------------------------------------------------------
+// Move only type erased callable. Callables up to InlineSize bytes are stored in place,
+// bigger ones fall back to the heap.
+class Task {
+public:
+    static constexpr std::size_t InlineSize = 56;
+
+    Task() = default;
+
+    template<typename F>
+    requires(!std::is_same_v<std::decay_t<F>, Task> && std::is_invocable_v<std::decay_t<F>&>)
+    Task(F&& func) {
+        using Func = std::decay_t<F>;
+
+        if constexpr (FitsInline<Func>) {
+            new (storage) Func(std::forward<F>(func));
+            ops = &InlineOps<Func>;
+        } else {
+            *reinterpret_cast<Func**>(storage) = new Func(std::forward<F>(func));
+            ops                                = &HeapOps<Func>;
+        }
+    }
+
+    Task(Task&& rhs) noexcept { moveFrom(rhs); }
+
+    Task& operator=(Task&& rhs) noexcept {
+        if (this != &rhs) {
+            reset();
+            moveFrom(rhs);
+        }
+        return *this;
+    }
+
+    Task(const Task&)            = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task() { reset(); }
+
+    void operator()() { ops->invoke(storage); }
+
+    explicit operator bool() const { return ops != nullptr; }
+
+    void reset() {
+        if (ops) {
+            ops->destroy(storage);
+            ops = nullptr;
+        }
+    }
+
+private:
+    struct Ops {
+        void (*invoke)(void*);
+        void (*move)(void*, void*);
+        void (*destroy)(void*);
+    };
+
+    template<typename F>
+    static constexpr bool FitsInline = sizeof(F) <= InlineSize &&
+                                       alignof(F) <= alignof(std::max_align_t) &&
+                                       std::is_nothrow_move_constructible_v<F>;
+
+    template<typename F>
+    static constexpr Ops InlineOps = {
+        [](void* s) { (*static_cast<F*>(s))(); },
+        [](void* dst, void* src) {
+            new (dst) F(std::move(*static_cast<F*>(src)));
+            static_cast<F*>(src)->~F();
+        },
+        [](void* s) { static_cast<F*>(s)->~F(); }};
+
+    template<typename F>
+    static constexpr Ops HeapOps = {
+        [](void* s) { (**static_cast<F**>(s))(); },
+        [](void* dst, void* src) { *static_cast<F**>(dst) = *static_cast<F**>(src); },
+        [](void* s) { delete *static_cast<F**>(s); }};
+
+    void moveFrom(Task& rhs) {
+        ops = rhs.ops;
+        if (ops) {
+            ops->move(storage, rhs.storage);
+            rhs.ops = nullptr;
+        }
+    }
+
+    const Ops* ops = nullptr;
+    alignas(std::max_align_t) std::byte storage[InlineSize];
+};
+
+// ------------------------------------------------------------------
+//      Task Latch
+// ------------------------------------------------------------------
+// Counts pending tasks of a batch. ThreadPool::submit() increments it and it is decremented
+// when each task finishes. The last decrement is the last access of the counting side, waiters
+// only poll, so the latch may be destroyed as soon as done() returns true.
+class TaskLatch {
+public:
+    explicit TaskLatch(std::ptrdiff_t count = 0) : count(count) {}
+
+    TaskLatch(const TaskLatch&)            = delete;
+    TaskLatch& operator=(const TaskLatch&) = delete;
+
+    void add(std::ptrdiff_t n = 1) { count.fetch_add(n, std::memory_order_relaxed); }
+
+    void countDown() { count.fetch_sub(1, std::memory_order_acq_rel); }
+
+    bool done() const { return count.load(std::memory_order_acquire) == 0; }
+
+    // Polls without helping, prefer ThreadPool::wait()
+    void wait() const {
+        while (!done())
+            std::this_thread::yield();
+    }
+
+private:
+    std::atomic<std::ptrdiff_t> count;
+};
+
+// ------------------------------------------------------------------
+//      Cancellation
+// ------------------------------------------------------------------
+// Tokens capture the generation of their source and become cancelled once the source moves
+// on. They share the counter with the source, which may go away first.
+class CancelToken {
+public:
+    using Counter = std::atomic<std::uint64_t>;
+
+    CancelToken() = default;
+    CancelToken(std::shared_ptr<const Counter> source, std::uint64_t generation)
+        : source(std::move(source)), generation(generation) {}
+
+    bool cancelled() const {
+        return source && source->load(std::memory_order_acquire) != generation;
+    }
+
+private:
+    std::shared_ptr<const Counter> source;
+    std::uint64_t                  generation = 0;
+};
+
+class CancelSource {
+public:
+    CancelSource() = default;
+
+    CancelSource(const CancelSource&)            = delete;
+    CancelSource& operator=(const CancelSource&) = delete;
+
+    CancelToken token() const { return {generation, generation->load(std::memory_order_acquire)}; }
+
+    // Cancels every token handed out so far
+    void cancel() { generation->fetch_add(1, std::memory_order_acq_rel); }
+
+    // Some token of this source is still around
+    bool referenced() const { return generation.use_count() > 1; }
+
+private:
+    std::shared_ptr<CancelToken::Counter> generation = std::make_shared<CancelToken::Counter>(0);
+};
+
+template<typename F>
+concept CancellableTask = std::is_invocable_v<F&, const CancelToken&>;
+
+// ------------------------------------------------------------------
+//      Thread Pool
+// ------------------------------------------------------------------
+// Work stealing thread pool. Each worker owns a deque where tasks submitted from that worker
+// go, other threads submit through a shared injection queue. Idle workers steal from others.
 class ThreadPool {
 public:
-    explicit ThreadPool(std::size_t numThreads, InitThreadFunc&& initFunc = nullptr);
-    ~ThreadPool() { stopWorkers(); }
+    explicit ThreadPool(
+        std::size_t numThreads = DefaultNumThreads(), InitThreadFunc&& initFunc = nullptr);
+    ~ThreadPool();
 
     void stopWorkers();
 
@@ -29,6 +205,38 @@ public:
     ThreadPool& operator=(ThreadPool&&)      = delete;
     ThreadPool& operator=(const ThreadPool&) = delete;
 
+    // Fire and forget. Tasks live in pooled slots, so submitting doesn't allocate once the
+    // pool has warmed up and the callable fits inline.
+    template<typename F>
+    void submit(F&& func) {
+        push(Task{std::forward<F>(func)}, nullptr);
+    }
+
+    template<typename F>
+    void submit(TaskLatch& latch, F&& func) {
+        latch.add();
+        push(Task{std::forward<F>(func)}, &latch);
+    }
+
+    // Runs pending tasks on the calling thread until every task of the batch is done. Workers
+    // help with anything, other threads only with queued tasks of this batch, so a render thread
+    // never ends up running someone else's slow I/O.
+    void wait(TaskLatch& latch);
+
+    // Latest wins. Submitting with a key cancels every task previously submitted with the same
+    // key: queued ones are skipped and running ones see it through their token.
+    template<CancellableTask F>
+    void submitLatest(std::uint64_t key, F&& func) {
+        submit([token = supersede(key), func = std::forward<F>(func)]() mutable {
+            if (!token.cancelled())
+                func(token);
+        });
+    }
+
+    // Cancels outstanding work for key and returns a token for the new work. Keys are forgotten
+    // once every token of theirs is gone.
+    CancelToken supersede(std::uint64_t key);
+
     template<class F, class... Args>
     auto enqueue(F&& f, Args&&... args)
         -> std::future<typename std::invoke_result<F, Args...>::type> {
@@ -39,26 +247,173 @@ public:
 
         std::future<returnType> result = task->get_future();
 
-        {
-            std::lock_guard lock(queueMutex);
+        submit([task]() { (*task)(); });
+
+        return result;
+    }
+
+    // Splits [begin, end) into chunks of at least grain elements and calls func(chunkBegin,
+    // chunkEnd) for each of them. The calling thread runs chunks too and returns once all are done.
+    template<typename F>
+    void parallelFor(std::size_t begin, std::size_t end, std::size_t grain, F&& func) {
+        const auto numChunks = chunkCount(begin, end, grain);
+        if (numChunks <= 1) {
+            if (begin < end)
+                func(begin, end);
+            return;
+        }
 
-            DCHECK(!stop);
-            tasks.emplace([task]() { (*task)(); });
+        TaskLatch latch;
+        for (std::size_t c = 1; c < numChunks; ++c) {
+            const auto [b, e] = chunkRange(begin, end, numChunks, c);
+            submit(latch, [&func, b, e]() { func(b, e); });
         }
 
-        condition.notify_one();
+        const auto [b, e] = chunkRange(begin, end, numChunks, 0);
+        func(b, e);
+
+        wait(latch);
+    }
+
+    // Maps every chunk with map(chunkBegin, chunkEnd) and folds the partial results in chunk
+    // order with reduce(lhs, rhs), starting from identity
+    template<typename T, typename Map, typename Reduce>
+    T parallelReduce(
+        std::size_t begin, std::size_t end, std::size_t grain, T identity, Map&& map,
+        Reduce&& reduce) {
+        const auto numChunks = chunkCount(begin, end, grain);
+        if (numChunks <= 1)
+            return begin < end ? reduce(std::move(identity), map(begin, end)) : identity;
+
+        std::vector<T> partials(numChunks, identity);
+        parallelFor(0, numChunks, 1, [&](std::size_t cBegin, std::size_t cEnd) {
+            for (auto c = cBegin; c < cEnd; ++c) {
+                const auto [b, e] = chunkRange(begin, end, numChunks, c);
+                partials[c]       = map(b, e);
+            }
+        });
+
+        T result = std::move(identity);
+        for (auto& partial : partials)
+            result = reduce(std::move(result), std::move(partial));
 
         return result;
     }
 
+    std::size_t numWorkers() const { return workers.size(); }
+
+    // Index of the calling thread if it is one of this pool's workers, -1 otherwise
+    int workerIndex() const;
+
 private:
-    std::queue<std::function<void()>> tasks;
-    std::vector<std::thread>          workers;
-    std::mutex                        queueMutex;
-    std::condition_variable           condition;
-    bool                              stop = false;
+    struct TaskSlot {
+        Task                       task;
+        TaskLatch*                 latch = nullptr;
+        std::atomic<std::uint32_t> next  = 0;
+        std::uint32_t              index = 0;
+    };
+
+    // Lock free list of free task slots. Slots are allocated in chunks that live as long as
+    // the pool, the list head carries a tag to avoid ABA.
+    class SlotAllocator {
+    public:
+        SlotAllocator() = default;
+
+        TaskSlot* acquire();
+        void      release(TaskSlot* slot);
+
+    private:
+        static constexpr std::uint32_t ChunkSize = 512;
+        static constexpr std::uint32_t MaxChunks = 1024;
+        static constexpr std::uint32_t NilSlot   = ~std::uint32_t{0};
+
+        TaskSlot& slot(std::uint32_t idx) { return chunks[idx / ChunkSize][idx % ChunkSize]; }
+
+        void grow();
+
+        std::array<std::unique_ptr<TaskSlot[]>, MaxChunks> chunks;
+        std::atomic<std::uint32_t>                         numChunks = 0;
+        std::mutex                                         growMutex;
+
+        alignas(CacheLineSize) std::atomic<std::uint64_t> head = NilSlot;
+    };
+
+    struct alignas(CacheLineSize) Worker {
+        WorkStealingDeque<TaskSlot*> deque;
+        std::thread                  thread;
+    };
+
+    // Enough chunks to keep every worker and the caller busy while they finish unevenly
+    static constexpr std::size_t ChunksPerThread = 4;
+
+    std::size_t chunkCount(std::size_t begin, std::size_t end, std::size_t grain) const {
+        if (begin >= end)
+            return 0;
+
+        const auto maxChunks = (numWorkers() + 1) * ChunksPerThread;
+        const auto numChunks = (end - begin + std::max<std::size_t>(grain, 1) - 1) /
+                               std::max<std::size_t>(grain, 1);
+        return std::min(numChunks, maxChunks);
+    }
+
+    static std::pair<std::size_t, std::size_t>
+    chunkRange(std::size_t begin, std::size_t end, std::size_t numChunks, std::size_t c) {
+        const auto size = end - begin;
+        return {begin + size * c / numChunks, begin + size * (c + 1) / numChunks};
+    }
+
+    void      push(Task&& task, TaskLatch* latch);
+    TaskSlot* findTask(int idx);
+    TaskSlot* popInjected(const TaskLatch* latch = nullptr);
+    void      run(TaskSlot* slot);
+    void      workerLoop(std::size_t idx, const InitThreadFunc& initFunc);
+
+    SlotAllocator                        slots;
+    std::vector<std::unique_ptr<Worker>> workers;
+
+    std::mutex            injectMutex;
+    std::deque<TaskSlot*> injectQueue;
+
+    std::mutex                                                       keysMutex;
+    std::unordered_map<std::uint64_t, std::unique_ptr<CancelSource>> keySources;
+
+    alignas(CacheLineSize) std::atomic<std::size_t> numInjected = 0;
+    alignas(CacheLineSize) std::atomic<std::uint32_t> wakeEpoch = 0;
+    std::atomic<std::uint32_t> numSleeping                      = 0;
+    std::atomic<bool>          stop                             = false;
 };
 
+// ------------------------------------------------------------------
+//      Global Pool
+// ------------------------------------------------------------------
+// Pool used by code that doesn't own one, like image processing. Without one set, the parallel
+// helpers below simply run on the calling thread.
+void        SetGlobalThreadPool(ThreadPool* pool);
+ThreadPool* GlobalThreadPool();
+
+// Smallest amount of cheap per item work, like converting pixels, worth handing to another thread
+inline constexpr std::size_t MinItemsPerTask = 16384;
+
+template<typename F>
+void ParallelFor(std::size_t begin, std::size_t end, std::size_t grain, F&& func) {
+    if (auto pool = GlobalThreadPool())
+        pool->parallelFor(begin, end, grain, std::forward<F>(func));
+    else if (begin < end)
+        func(begin, end);
+}
+
+template<typename T, typename Map, typename Reduce>
+T ParallelReduce(
+    std::size_t begin, std::size_t end, std::size_t grain, T identity, Map&& map,
+    Reduce&& reduce) {
+    if (auto pool = GlobalThreadPool())
+        return pool->parallelReduce(
+            begin, end, grain, std::move(identity), std::forward<Map>(map),
+            std::forward<Reduce>(reduce));
+
+    return begin < end ? reduce(std::move(identity), map(begin, end)) : identity;
+}
+
 } // namespace sdbox
 
 #endif
\ No newline at end of file
@@ -1,6 +1,10 @@
 #include <util.h>
 #include <fstream>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
 using namespace sdbox;
 using namespace sdbox::util;
 
@@ -27,6 +31,22 @@ std::optional<std::string> util::ReadTextFile(const fs::path& filePath) {
     return contents;
 }
 
+bool util::WriteTextFile(const fs::path& filePath, std::string_view contents) {
+    std::ofstream file(filePath, std::ios_base::out | std::ios_base::trunc);
+    if (file.fail()) {
+        LOG_ERROR("Failed to open file {}. {}", filePath.string(), std::strerror(errno));
+        return false;
+    }
+
+    file.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+    if (file.fail()) {
+        LOG_ERROR("Failed to write file {}. {}", filePath.string(), std::strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
 std::optional<BinaryData> util::ReadBinaryFile(const fs::path& filePath) {
     std::ifstream file(filePath, std::ios_base::binary | std::ios_base::in | std::ios_base::ate);
     if (file.fail()) {
@@ -51,4 +71,48 @@ std::optional<BinaryData> util::ReadBinaryFile(const fs::path& filePath) {
     bin.filename = filePath.filename();
 
     return bin;
+}
+
+MappedFile::MappedFile(const fs::path& filePath, std::size_t size) : fileSize(size) {
+    fd = open(filePath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        LOG_ERROR("Failed to open file {}. {}", filePath.string(), std::strerror(errno));
+        return;
+    }
+
+    if (ftruncate(fd, static_cast<off_t>(size)) == -1) {
+        LOG_ERROR("Failed to resize file {}. {}", filePath.string(), std::strerror(errno));
+        return;
+    }
+
+    void* mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapped == MAP_FAILED) {
+        LOG_ERROR("Failed to map file {}. {}", filePath.string(), std::strerror(errno));
+        return;
+    }
+
+    ptr = static_cast<std::byte*>(mapped);
+}
+
+MappedFile::~MappedFile() {
+    if (ptr) {
+        msync(ptr, fileSize, MS_SYNC);
+        munmap(ptr, fileSize);
+    }
+
+    if (fd != -1)
+        close(fd);
+}
+
+void MappedFile::release(std::size_t offset, std::size_t size) const {
+    // Only whole pages inside the range, pages shared with neighbours stay
+    const auto pageSize = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    const auto begin    = (offset + pageSize - 1) / pageSize * pageSize;
+    const auto end      = std::min(offset + size, fileSize) / pageSize * pageSize;
+    if (!ptr || begin >= end)
+        return;
+
+    // Dirty pages of a shared mapping stay in the page cache until written back
+    msync(ptr + begin, end - begin, MS_ASYNC);
+    madvise(ptr + begin, end - begin, MADV_DONTNEED);
 }
\ No newline at end of file
@@ -5,6 +5,7 @@
 
 #include <optional>
 #include <filesystem>
+#include <string_view>
 
 #include <xxhash/xxhash.hpp>
 #include <xxhash/constexpr-xxh3.h>
@@ -31,6 +32,31 @@ struct BinaryData {
 
 std::optional<std::string> ReadTextFile(const fs::path& filePath);
 std::optional<BinaryData>  ReadBinaryFile(const fs::path& filePath);
+bool                       WriteTextFile(const fs::path& filePath, std::string_view contents);
+
+// File of a fixed size mapped read/write into memory. Written pages go back to the file and
+// can be dropped from memory with release().
+class MappedFile {
+public:
+    MappedFile(const fs::path& filePath, std::size_t size);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&)            = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool isOpen() const { return ptr != nullptr; }
+
+    std::byte*  data() const { return ptr; }
+    std::size_t size() const { return fileSize; }
+
+    // Starts writing the range back and unmaps its pages, they are read back in if touched again
+    void release(std::size_t offset, std::size_t size) const;
+
+private:
+    std::byte*  ptr      = nullptr;
+    std::size_t fileSize = 0;
+    int         fd       = -1;
+};
 
 // ------------------------------------------------------------------
 //     Hash functions
@@ -51,6 +77,10 @@ inline HashResult64 HashBytes64(const std::string& str) {
     return xxh::xxhash3<64>(str);
 }
 
+inline HashResult64 HashBytes64(std::string_view str) {
+    return xxh::xxhash3<64>(str.data(), str.size());
+}
+
 inline HashResult128 HashBytes128(const std::byte* bytes, std::size_t len) {
     return xxh::xxhash3<128>(bytes, len);
 }
@@ -0,0 +1,190 @@
+#include <video.h>
+#include <thread.h>
+
+#include <csignal>
+#include <cstring>
+
+using namespace sdbox;
+
+namespace {
+
+constexpr std::string_view FrameTag = "FRAME\n";
+
+// BT.709 limited range in 8.8 fixed point. Plain loops over contiguous rows, which the
+// compiler vectorizes.
+inline std::uint8_t LumaOf(int r, int g, int b) {
+    return static_cast<std::uint8_t>(((47 * r + 157 * g + 16 * b + 128) >> 8) + 16);
+}
+
+inline std::uint8_t CbOf(int r, int g, int b) {
+    return static_cast<std::uint8_t>(((-26 * r - 86 * g + 112 * b + 128) >> 8) + 128);
+}
+
+inline std::uint8_t CrOf(int r, int g, int b) {
+    return static_cast<std::uint8_t>(((112 * r - 102 * g - 10 * b + 128) >> 8) + 128);
+}
+
+} // namespace
+
+VideoWriter::VideoWriter(
+    const std::string& target, VideoFormat format, int width, int height, double frameRate,
+    int firstFrame)
+    : format(format), width(width), height(height), firstFrame(firstFrame),
+      nextFrame(firstFrame) {
+    if (target.starts_with('|')) {
+        // A reader going away must fail the write instead of killing the process
+        std::signal(SIGPIPE, SIG_IGN);
+        out    = popen(target.c_str() + 1, "w");
+        isPipe = true;
+    } else {
+        out = std::fopen(target.c_str(), "wb");
+    }
+
+    if (!out) {
+        LOG_ERROR("Failed to open video output {}. {}", target, std::strerror(errno));
+        return;
+    }
+
+    if (format == VideoFormat::Y4M) {
+        const auto rate   = static_cast<long>(std::lround(frameRate * 1000.0));
+        const auto header = std::format(
+            "YUV4MPEG2 W{} H{} F{}:1000 Ip A1:1 C420jpeg XCOLORRANGE=LIMITED\n", width, height,
+            rate);
+        std::fwrite(header.data(), 1, header.size(), out);
+    }
+}
+
+VideoWriter::~VideoWriter() {
+    if (!pending.empty())
+        LOG_ERROR(
+            "Video output dropped {} frames after missing frame {}.", pending.size(), nextFrame);
+
+    if (!out)
+        return;
+
+    if (isPipe)
+        pclose(out);
+    else
+        std::fclose(out);
+}
+
+int VideoWriter::framesWritten() const {
+    std::lock_guard lock{mutex};
+    return nextFrame - firstFrame;
+}
+
+std::size_t VideoWriter::frameSize() const {
+    const std::size_t numPixels = static_cast<std::size_t>(width) * height;
+    if (format == VideoFormat::RawRGBA)
+        return numPixels * 4;
+
+    const std::size_t chromaSize = static_cast<std::size_t>((width + 1) / 2) * ((height + 1) / 2);
+    return FrameTag.size() + numPixels + 2 * chromaSize;
+}
+
+void VideoWriter::write(int frame, const std::byte* pixels) {
+    if (!out)
+        return;
+
+    Bytes buffer;
+    {
+        std::lock_guard lock{mutex};
+        if (!freeBuffers.empty()) {
+            buffer = std::move(freeBuffers.back());
+            freeBuffers.pop_back();
+        }
+    }
+
+    // Conversion runs outside the lock, frames convert concurrently
+    buffer.resize(frameSize());
+    if (format == VideoFormat::Y4M)
+        convertY4M(pixels, buffer.data());
+    else
+        convertRGBA(pixels, buffer.data());
+
+    std::unique_lock lock{mutex};
+    pending.emplace(frame, std::move(buffer));
+
+    // Someone is already writing, it picks this frame up if it's next
+    if (writing)
+        return;
+
+    writing = true;
+    while (!pending.empty() && pending.begin()->first == nextFrame) {
+        auto node = pending.extract(pending.begin());
+
+        lock.unlock();
+        auto& bytes = node.mapped();
+        bool  ok    = true;
+        if (!failed && std::fwrite(bytes.data(), 1, bytes.size(), out) != bytes.size()) {
+            LOG_ERROR(
+                "Failed to write video frame {}, dropping the rest. {}", node.key(),
+                errno == EPIPE ? "The command exited." : std::strerror(errno));
+            ok = false;
+        }
+        lock.lock();
+
+        failed = failed || !ok;
+
+        freeBuffers.push_back(std::move(bytes));
+        ++nextFrame;
+    }
+    writing = false;
+}
+
+void VideoWriter::convertY4M(const std::byte* pixels, std::byte* dst) const {
+    const auto src = reinterpret_cast<const std::uint8_t*>(pixels);
+
+    std::memcpy(dst, FrameTag.data(), FrameTag.size());
+
+    const int  chromaW = (width + 1) / 2;
+    const int  chromaH = (height + 1) / 2;
+    const auto yPlane  = reinterpret_cast<std::uint8_t*>(dst + FrameTag.size());
+    const auto uPlane  = yPlane + static_cast<std::size_t>(width) * height;
+    const auto vPlane  = uPlane + static_cast<std::size_t>(chromaW) * chromaH;
+
+    const auto grain = std::max<std::size_t>(1, MinItemsPerTask / (2 * width));
+
+    // Every task converts pairs of luma rows and the chroma row they share
+    ParallelFor(0, chromaH, grain, [&](std::size_t begin, std::size_t end) {
+        for (auto cy = begin; cy < end; ++cy) {
+            const int y0 = static_cast<int>(cy) * 2;
+            const int y1 = std::min(y0 + 1, height - 1);
+
+            // Source is bottom row first
+            const auto row0 = src + static_cast<std::size_t>(height - 1 - y0) * width * 4;
+            const auto row1 = src + static_cast<std::size_t>(height - 1 - y1) * width * 4;
+
+            const auto luma0 = yPlane + static_cast<std::size_t>(y0) * width;
+            const auto luma1 = yPlane + static_cast<std::size_t>(y1) * width;
+            for (int x = 0; x < width; ++x) {
+                luma0[x] = LumaOf(row0[x * 4], row0[x * 4 + 1], row0[x * 4 + 2]);
+                luma1[x] = LumaOf(row1[x * 4], row1[x * 4 + 1], row1[x * 4 + 2]);
+            }
+
+            const auto cb = uPlane + cy * chromaW;
+            const auto cr = vPlane + cy * chromaW;
+            for (int cx = 0; cx < chromaW; ++cx) {
+                const int x0 = cx * 4 * 2;
+                const int x1 = std::min(cx * 2 + 1, width - 1) * 4;
+
+                const int r = (row0[x0] + row0[x1] + row1[x0] + row1[x1] + 2) >> 2;
+                const int g = (row0[x0 + 1] + row0[x1 + 1] + row1[x0 + 1] + row1[x1 + 1] + 2) >> 2;
+                const int b = (row0[x0 + 2] + row0[x1 + 2] + row1[x0 + 2] + row1[x1 + 2] + 2) >> 2;
+
+                cb[cx] = CbOf(r, g, b);
+                cr[cx] = CrOf(r, g, b);
+            }
+        }
+    });
+}
+
+void VideoWriter::convertRGBA(const std::byte* pixels, std::byte* dst) const {
+    const auto stride = static_cast<std::size_t>(width) * 4;
+    const auto grain  = std::max<std::size_t>(1, MinItemsPerTask / width);
+
+    ParallelFor(0, height, grain, [&](std::size_t begin, std::size_t end) {
+        for (auto y = begin; y < end; ++y)
+            std::memcpy(dst + y * stride, pixels + (height - 1 - y) * stride, stride);
+    });
+}
\ No newline at end of file
@@ -0,0 +1,64 @@
+#ifndef SDBOX_VIDEO_H
+#define SDBOX_VIDEO_H
+
+#include <sdbox.h>
+
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace sdbox {
+
+enum class VideoFormat { Y4M, RawRGBA };
+
+// Streams frames to a file or to the stdin of a command ("|cmd"), stdout is taken by the logs.
+// Frames can be written from any thread and out of order: each one is converted by its caller,
+// split over the global pool, and written out in frame order by whoever completes the sequence.
+// Y4M is 4:2:0 BT.709 limited range, raw frames are RGBA top row first. A command exiting early
+// is a write error rather than a SIGPIPE, the frames after it are dropped.
+class VideoWriter {
+public:
+    VideoWriter(
+        const std::string& target, VideoFormat format, int width, int height, double frameRate,
+        int firstFrame = 0);
+    ~VideoWriter();
+
+    VideoWriter(const VideoWriter&)            = delete;
+    VideoWriter& operator=(const VideoWriter&) = delete;
+
+    bool isOpen() const { return out != nullptr; }
+
+    // 8 bit RGBA pixels bottom row first, as read back from OpenGL. Frame numbers must not have
+    // gaps, a frame is only written once every previous one was.
+    void write(int frame, const std::byte* pixels);
+
+    int framesWritten() const;
+
+private:
+    using Bytes = std::vector<std::byte>;
+
+    void convertY4M(const std::byte* pixels, std::byte* dst) const;
+    void convertRGBA(const std::byte* pixels, std::byte* dst) const;
+
+    std::size_t frameSize() const;
+
+    VideoFormat format;
+    int         width  = 0;
+    int         height = 0;
+    std::FILE*  out    = nullptr;
+    bool        isPipe = false;
+
+    mutable std::mutex   mutex;
+    std::map<int, Bytes> pending;
+    std::vector<Bytes>   freeBuffers;
+    int                  firstFrame = 0;
+    int                  nextFrame  = 0;
+    bool                 writing    = false;
+    bool                 failed     = false; // A write failed, later frames are dropped
+};
+
+} // namespace sdbox
+
+#endif
\ No newline at end of file
@@ -81,7 +81,7 @@ void InotifyWatcher::addDirectory(const fs::path& dirPath) {
     if (handle == -1)
         FATAL("Failed to create a watch for {}.", dirPath.string());
 
-    watchHandles[handle] = dirPath;
+    watchHandles[handle] = paths.intern(dirPath.string());
 }
 
 void InotifyWatcher::removeWatch(int handle) {
@@ -114,34 +114,37 @@ std::size_t InotifyWatcher::readPoll() {
 }
 
 int InotifyWatcher::getDirHandle(const std::string& dirPath) const {
-    for (const auto& [handle, path] : watchHandles)
-        if (path == dirPath)
+    for (const auto& [handle, pathId] : watchHandles)
+        if (paths.get(pathId) == dirPath)
             return handle;
 
     LOG_WARN("Couldn't find watch handle for {}.", dirPath);
     return -1;
 }
 
-std::string InotifyWatcher::getDirPath(int handle) const {
+std::string_view InotifyWatcher::getDirPath(int handle) const {
     auto it = watchHandles.find(handle);
     if (it != watchHandles.end())
-        return it->second;
+        return paths.get(it->second);
 
     LOG_WARN("Trying to query folder to unknown handle");
     return "";
 }
 
-WatcherEvent InotifyWatcher::createEvent(const inotify_event& ev) {
-    WatcherEvent event;
-    event.type    = MaskToEventType(ev.mask);
-    event.name    = ev.name;
-    event.isDir   = ev.mask & IN_ISDIR;
-    event.dirPath = getDirPath(ev.wd);
+CompactEvent InotifyWatcher::createEvent(const inotify_event& ev) {
+    CompactEvent event;
+    event.type   = MaskToEventType(ev.mask);
+    event.nameId = paths.intern(ev.name);
+    event.isDir  = ev.mask & IN_ISDIR;
+
+    auto dirIt = watchHandles.find(ev.wd);
+    if (dirIt != watchHandles.end())
+        event.dirId = dirIt->second;
 
     if (event.type == EventType::FileMoved) {
         auto it = renameMap.find(ev.cookie);
         if (it != renameMap.end()) {
-            event.oldName = it->second;
+            event.oldNameId = it->second;
             renameMap.erase(it);
         }
     }
@@ -150,7 +153,7 @@ WatcherEvent InotifyWatcher::createEvent(const inotify_event& ev) {
 }
 
 bool InotifyWatcher::filterEvent(const inotify_event& ev) {
-    std::string fname = ev.name;
+    std::string_view fname = ev.name;
 
     if (ev.mask & IN_DELETE_SELF) {
         LOGI("Stopped watching {}. Folder was deleted.", getDirPath(ev.wd));
@@ -165,7 +168,7 @@ bool InotifyWatcher::filterEvent(const inotify_event& ev) {
 
     // Register move/rename
     if (ev.mask & IN_MOVED_FROM) {
-        renameMap.emplace(ev.cookie, fname);
+        renameMap.emplace(ev.cookie, paths.intern(fname));
         return true;
     }
 
@@ -182,31 +185,22 @@ void InotifyWatcher::readFromBuffer(std::size_t size) {
     while (i < size) {
         auto notifEv = reinterpret_cast<inotify_event*>(&readBuffer[i]);
 
-        if (!filterEvent(*notifEv)) {
-            auto newEvent = createEvent(*notifEv);
-            eventQueue.push(newEvent);
-        }
+        if (!filterEvent(*notifEv))
+            pushEvent(createEvent(*notifEv));
 
         i += EventStructSize + notifEv->len;
     }
 }
 
-void InotifyWatcher::dispatchEvents() {
-    while (!eventQueue.empty()) {
-        auto ev = eventQueue.front();
-        eventQueue.pop();
-
-        auto it = callbacks.find(ev.type);
-        if (it != callbacks.end())
-            it->second(ev);
-    }
-}
-
 void InotifyWatcher::watch() {
     while (!hasStopped()) {
         auto len = readPoll();
+        if (len == 0)
+            continue;
+
+        // Callbacks run on the consumer's thread, only notify it here
         readFromBuffer(len);
-        dispatchEvents();
+        notify();
     };
 }
 
@@ -7,8 +7,6 @@
 #include <sys/inotify.h>
 #include <unistd.h>
 
-#include <queue>
-
 namespace sdbox {
 
 constexpr auto EventStructSize = sizeof(inotify_event);
@@ -33,24 +31,22 @@ public:
 private:
     void removeWatch(int handle);
 
-    std::string getDirPath(int handle) const;
-    int         getDirHandle(const std::string& dirPath) const;
+    std::string_view getDirPath(int handle) const;
+    int              getDirHandle(const std::string& dirPath) const;
 
-    WatcherEvent createEvent(const inotify_event& ev);
+    CompactEvent createEvent(const inotify_event& ev);
 
     std::size_t readPoll();
     void        readFromBuffer(std::size_t size);
     bool        filterEvent(const inotify_event& ev);
-    void        dispatchEvents();
 
     void setError(int errNo) { error = errNo; }
     bool hasStopped();
     void cleanup();
 
-    std::map<std::uint32_t, std::string> renameMap{};
+    std::map<std::uint32_t, PathId> renameMap{};
 
     std::array<char, MaxEventSize> readBuffer;
-    std::queue<WatcherEvent>       eventQueue;
 
     epoll_event inotifyEv;
     epoll_event stopPipeEv;
@@ -63,7 +59,7 @@ private:
     int inotifyFd = -1;
     int epollFd   = -1;
 
-    std::map<int, std::string> watchHandles;
+    std::map<int, PathId> watchHandles;
 
     int error;
 };
@@ -2,8 +2,204 @@
 
 #include <watcher/inotifywatcher.h>
 
+#include <algorithm>
+#include <bit>
+
 using namespace sdbox;
 
+namespace {
+
+constexpr SubscriberMask NotMatched = ~SubscriberMask{0};
+
+bool MatchGlob(std::string_view pattern, std::string_view str) {
+    std::size_t p = 0, s = 0;
+    std::size_t starP = std::string_view::npos, starS = 0;
+
+    while (s < str.size()) {
+        if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == str[s])) {
+            ++p;
+            ++s;
+        } else if (p < pattern.size() && pattern[p] == '*') {
+            starP = p++;
+            starS = s;
+        } else if (starP != std::string_view::npos) {
+            // Backtrack, let the last star consume one more character
+            p = starP + 1;
+            s = ++starS;
+        } else {
+            return false;
+        }
+    }
+
+    while (p < pattern.size() && pattern[p] == '*')
+        ++p;
+
+    return p == pattern.size();
+}
+
+} // namespace
+
+GlobPattern::GlobPattern(std::string_view pat) : pattern(pat) {
+    const auto wildcards = pattern.find_first_of("*?");
+    const auto lastStar  = pattern.find_last_of('*');
+    const bool oneStar   = wildcards == lastStar && pattern.find('?') == std::string::npos;
+
+    if (pattern == "*") {
+        kind = Kind::Any;
+    } else if (wildcards == std::string::npos) {
+        kind    = Kind::Exact;
+        literal = pattern;
+    } else if (oneStar && wildcards == 0) {
+        kind    = Kind::Suffix;
+        literal = pattern.substr(1);
+    } else if (oneStar && wildcards == pattern.size() - 1) {
+        kind    = Kind::Prefix;
+        literal = pattern.substr(0, wildcards);
+    }
+}
+
+bool GlobPattern::matches(std::string_view name) const {
+    switch (kind) {
+    case Kind::Any:
+        return true;
+    case Kind::Exact:
+        return name == literal;
+    case Kind::Suffix:
+        return name.ends_with(literal);
+    case Kind::Prefix:
+        return name.starts_with(literal);
+    case Kind::Glob:
+        return MatchGlob(pattern, name);
+    }
+
+    return false;
+}
+
+PathId PathTable::intern(std::string_view str) {
+    auto it = ids.find(str);
+    if (it != ids.end())
+        return it->second;
+
+    // Only the watcher thread writes, its own reads need no ordering
+    const auto curr  = count.load(std::memory_order_relaxed);
+    const auto chunk = curr / ChunkSize;
+    if (chunk >= MaxChunks) {
+        LOG_WARN("Path table is full, can't intern {}.", str);
+        return InvalidPathId;
+    }
+
+    if (!chunks[chunk])
+        chunks[chunk] = std::make_unique<std::string[]>(ChunkSize);
+
+    auto& entry = chunks[chunk][curr % ChunkSize];
+    entry       = str;
+
+    const auto id = static_cast<PathId>(curr);
+    ids.emplace(entry, id);
+    count.store(curr + 1, std::memory_order_release);
+
+    return id;
+}
+
+std::string_view PathTable::get(PathId id) const {
+    if (id == InvalidPathId)
+        return {};
+
+    DCHECK_LT(id, count.load(std::memory_order_acquire));
+    return chunks[id / ChunkSize][id % ChunkSize];
+}
+
+SubscriptionId DirectoryWatcher::subscribe(
+    std::initializer_list<std::string_view> patterns, EventTypeMask types,
+    EventCallback&& callback) {
+    if (subscriptions.size() == MaxSubscriptions)
+        FATAL("Exceeded maximum number of watcher subscriptions ({}).", MaxSubscriptions);
+
+    const auto id = subscriptions.size();
+
+    Subscription sub{.patterns = {}, .types = types, .callback = std::move(callback)};
+    for (auto pattern : patterns)
+        sub.patterns.emplace_back(pattern);
+
+    subscriptions.push_back(std::move(sub));
+
+    for (std::size_t t = 0; t < typeSubscribers.size(); ++t)
+        if (types & (EventTypeMask{1} << t))
+            typeSubscribers[t] |= SubscriberMask{1} << id;
+
+    // Names matched so far need to be checked against the new subscription
+    matchCache.clear();
+
+    return id;
+}
+
+SubscriberMask DirectoryWatcher::matchSubscribers(PathId nameId) {
+    if (nameId == InvalidPathId)
+        return 0;
+
+    if (nameId >= matchCache.size())
+        matchCache.resize(nameId + 1, NotMatched);
+
+    auto& mask = matchCache[nameId];
+    if (mask != NotMatched)
+        return mask;
+
+    const auto name = paths.get(nameId);
+
+    mask = 0;
+    for (std::size_t s = 0; s < subscriptions.size(); ++s) {
+        const auto& patterns = subscriptions[s].patterns;
+        auto matchesName     = [&](const GlobPattern& p) { return p.matches(name); };
+
+        if (std::any_of(patterns.begin(), patterns.end(), matchesName))
+            mask |= SubscriberMask{1} << s;
+    }
+
+    return mask;
+}
+
+void DirectoryWatcher::pushEvent(const CompactEvent& ev) {
+    auto matched = ev;
+    matched.subscribers =
+        matchSubscribers(ev.nameId) & typeSubscribers[static_cast<std::uint8_t>(ev.type)];
+
+    // Nobody is interested in this event
+    if (matched.subscribers == 0)
+        return;
+
+    if (!eventQueue.push(matched))
+        dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+WatcherEvent DirectoryWatcher::resolve(const CompactEvent& ev) const {
+    return {
+        .dirPath = paths.get(ev.dirId),
+        .name    = paths.get(ev.nameId),
+        .oldName = paths.get(ev.oldNameId),
+        .nameId  = ev.nameId,
+        .type    = ev.type,
+        .isDir   = ev.isDir};
+}
+
+std::size_t DirectoryWatcher::dispatchEvents() {
+    auto numDropped = dropped.exchange(0, std::memory_order_relaxed);
+    if (numDropped > 0)
+        writeToErrorCallback(std::format("Event queue full, dropped {} events.", numDropped));
+
+    std::size_t numEvents = 0;
+    while (auto ev = eventQueue.pop()) {
+        const auto event = resolve(*ev);
+
+        // Fan out to matched subscribers only
+        for (auto mask = ev->subscribers; mask != 0; mask &= mask - 1)
+            subscriptions[std::countr_zero(mask)].callback(event);
+
+        ++numEvents;
+    }
+
+    return numEvents;
+}
+
 std::unique_ptr<DirectoryWatcher> sdbox::CreateDirectoryWatcher(const fs::path& path) {
     return std::make_unique<InotifyWatcher>(path);
 }
\ No newline at end of file
@@ -2,10 +2,14 @@
 #define SDBOX_WATCHER_H
 
 #include <sdbox.h>
+#include <lockfree.h>
 
 #include <filesystem>
 #include <functional>
 #include <ostream>
+#include <string_view>
+#include <unordered_map>
+#include <initializer_list>
 
 namespace fs = std::filesystem;
 
@@ -13,7 +17,23 @@ namespace sdbox {
 
 class InotifyWatcher;
 
-enum class EventType { Unknown, FileCreated, FileDeleted, FileChanged, FileMoved };
+enum class EventType : std::uint8_t { Unknown, FileCreated, FileDeleted, FileChanged, FileMoved };
+
+using EventTypeMask = std::uint32_t;
+
+constexpr EventTypeMask AllEventTypes = ~EventTypeMask{0};
+
+constexpr EventTypeMask ToMask(EventType type) {
+    return EventTypeMask{1} << static_cast<std::uint8_t>(type);
+}
+
+constexpr EventTypeMask operator|(EventType lhs, EventType rhs) {
+    return ToMask(lhs) | ToMask(rhs);
+}
+
+constexpr EventTypeMask operator|(EventTypeMask lhs, EventType rhs) {
+    return lhs | ToMask(rhs);
+}
 
 inline std::ostream& operator<<(std::ostream& stream, const EventType& type) {
     using enum EventType;
@@ -38,12 +58,70 @@ inline std::ostream& operator<<(std::ostream& stream, const EventType& type) {
     return stream;
 }
 
+using PathId = std::uint32_t;
+
+constexpr PathId InvalidPathId = ~PathId{0};
+
+// Append only string table. Strings are interned on the watcher thread only, while ids
+// received through the event queue can be resolved from the consumer thread.
+class PathTable {
+public:
+    PathTable() = default;
+
+    PathTable(const PathTable&)            = delete;
+    PathTable& operator=(const PathTable&) = delete;
+
+    PathId           intern(std::string_view str);
+    std::string_view get(PathId id) const;
+
+private:
+    static constexpr std::size_t ChunkSize = 256;
+    static constexpr std::size_t MaxChunks = 1024;
+
+    std::array<std::unique_ptr<std::string[]>, MaxChunks> chunks;
+    std::unordered_map<std::string_view, PathId>          ids;
+    std::atomic<std::size_t>                              count = 0; // Published with release
+};
+
+// File name pattern compiled once at subscription time. Supports exact names, '*' and '?'
+// wildcards, with fast paths for the common "*.ext" and "prefix*" forms.
+class GlobPattern {
+public:
+    explicit GlobPattern(std::string_view pattern);
+
+    bool matches(std::string_view name) const;
+
+private:
+    enum class Kind { Any, Exact, Suffix, Prefix, Glob };
+
+    std::string pattern;
+    std::string literal;
+    Kind        kind = Kind::Glob;
+};
+
+using SubscriberMask = std::uint64_t;
+
+constexpr std::size_t MaxSubscriptions = 64;
+
+// Event as pushed by the watcher thread
+struct CompactEvent {
+    SubscriberMask subscribers = 0;
+    PathId         dirId       = InvalidPathId;
+    PathId         nameId      = InvalidPathId;
+    PathId         oldNameId   = InvalidPathId;
+    EventType      type        = EventType::Unknown;
+    bool           isDir       = false;
+};
+
+// Event as seen by callbacks. Views point to interned strings and remain valid
+// for the lifetime of the watcher.
 struct WatcherEvent {
-    std::string dirPath;
-    std::string name;
-    std::string oldName;
-    EventType   type;
-    bool        isDir;
+    std::string_view dirPath;
+    std::string_view name;
+    std::string_view oldName;
+    PathId           nameId;
+    EventType        type;
+    bool             isDir;
 };
 
 inline std::ostream& operator<<(std::ostream& stream, const WatcherEvent& ev) {
@@ -58,8 +136,18 @@ inline std::ostream& operator<<(std::ostream& stream, const WatcherEvent& ev) {
     return stream;
 }
 
-using EventCallback = std::function<void(const WatcherEvent&)>;
-using ErrorCallback = std::function<void(const std::string&)>;
+using EventCallback  = std::function<void(const WatcherEvent&)>;
+using ErrorCallback  = std::function<void(const std::string&)>;
+using NotifyCallback = std::function<void()>;
+using SubscriptionId = std::size_t;
+
+constexpr std::size_t EventQueueSize = 1024;
+
+struct Subscription {
+    std::vector<GlobPattern> patterns;
+    EventTypeMask            types;
+    EventCallback            callback;
+};
 
 class DirectoryWatcher {
 public:
@@ -73,26 +161,55 @@ public:
     virtual void addDirectory(const fs::path& dirPath)    = 0;
     virtual void removeDirectory(const fs::path& dirPath) = 0;
 
+    // Subscriptions must be registered before watch() is called. Events are matched on the
+    // watcher thread, once per file name, and only reach subscribers whose patterns match.
+    SubscriptionId subscribe(
+        std::initializer_list<std::string_view> patterns, EventTypeMask types,
+        EventCallback&& callback);
+
     void registerCallback(EventType type, EventCallback&& callback) {
-        callbacks.emplace(type, std::move(callback));
+        subscribe({"*"}, ToMask(type), std::move(callback));
     }
 
     void registerCallback(EventType type, const EventCallback& callback) {
-        callbacks.emplace(type, callback);
+        subscribe({"*"}, ToMask(type), EventCallback{callback});
     }
 
     void registerErrorCallback(ErrorCallback&& callback) { errorCallback = callback; }
 
+    // Called on the watcher thread whenever new events are queued. Must not block,
+    // it is meant to wake up whichever thread calls dispatchEvents().
+    void registerNotifyCallback(NotifyCallback&& callback) { notifyCallback = callback; }
+
+    // Drains queued events and runs callbacks on the calling thread
+    std::size_t dispatchEvents();
+
 protected:
+    void pushEvent(const CompactEvent& ev);
+    void notify() const {
+        if (notifyCallback)
+            notifyCallback();
+    }
+
     void writeToErrorCallback(const std::string& errMsg) {
         if (errorCallback)
             errorCallback(errMsg);
     }
 
-    bool hasCallback(EventType type) const { return callbacks.find(type) != callbacks.end(); }
+    SubscriberMask matchSubscribers(PathId nameId);
+    WatcherEvent   resolve(const CompactEvent& ev) const;
+
+    ErrorCallback  errorCallback  = nullptr;
+    NotifyCallback notifyCallback = nullptr;
+
+    // Compiled matcher table, read-only once watching
+    std::vector<Subscription>     subscriptions;
+    std::vector<SubscriberMask>   matchCache;
+    std::array<SubscriberMask, 8> typeSubscribers{};
 
-    ErrorCallback                      errorCallback = nullptr;
-    std::map<EventType, EventCallback> callbacks;
+    PathTable                                paths;
+    SpscQueue<CompactEvent, EventQueueSize> eventQueue;
+    std::atomic<std::size_t>                 dropped = 0;
 };
 
 std::unique_ptr<DirectoryWatcher> CreateDirectoryWatcher(const fs::path& dirPath);
@@ -58,12 +58,16 @@ struct WindowCallbacks {
 
 using OpenglContext = GLFWwindow;
 
+// How contexts are created. Headless backends need no display and render offscreen.
+enum class ContextBackend { Window, EGL, OSMesa };
+
 struct WindowOpts {
     int            width   = 1;
     int            height  = 1;
     bool           visible = false;
     std::string    title   = "sdbox";
     OpenglContext* share   = nullptr;
+    ContextBackend backend = ContextBackend::Window;
 };
 
 class Window {
@@ -80,6 +84,8 @@ public:
 
     void swapBuffers() const { glfwSwapBuffers(ctx); }
     void pollEvents() const { glfwPollEvents(); }
+    void waitEvents() const { glfwWaitEvents(); }
+    void waitEvents(double timeout) const { glfwWaitEventsTimeout(timeout); }
 
     void reshape(int w, int h);
     void processKeys(int key, int scancode, int action, int mods);
@@ -104,6 +110,11 @@ private:
 
 OpenglContext* CreateContext(const WindowOpts& opts);
 
+// Returns the main thread from waitEvents(), callable from any thread
+inline void WakeEventLoop() {
+    glfwPostEmptyEvent();
+}
+
 } // namespace sdbox
 
 #endif
\ No newline at end of file
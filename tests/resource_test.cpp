@@ -0,0 +1,89 @@
+#include <resource.h>
+#include <shader.h>
+#include <win.h>
+
+#include <glad/glad.h>
+
+using namespace sdbox;
+
+namespace {
+// ctest treats this as skipped
+constexpr int SkipCode = 77;
+
+int failures = 0;
+
+void Expect(bool cond, std::string_view what) {
+    if (!cond) {
+        LOG_ERROR("Failed: {}", what);
+        ++failures;
+    }
+}
+
+// Two versions of a program built from one source, the previous one evicted, still count the
+// source exactly once
+void SharedSourceSurvivesEviction() {
+    ResourceRegistry reg;
+
+    const auto source   = std::make_shared<const std::string>("void main() {}");
+    const auto nameHash = Hash("main.glsl");
+
+    reg.addResource("main.glsl", nameHash, 1, std::make_unique<Program>("v1"), source);
+    reg.addResource("main.glsl", nameHash, 2, std::make_unique<Program>("v2"), source);
+
+    // Unlinked programs have no binary, what's left is the source
+    Expect(reg.memoryUsage() == source->size(), "shared source counted once");
+
+    reg.setMemoryBudget(0);
+    reg.collectGarbage([](Task&& deleter) { deleter(); });
+
+    const auto previous = reg.slot<Program>(nameHash).previous();
+    Expect(previous.size() == 1 && !previous.front().handle, "previous version evicted");
+    Expect(reg.memoryUsage() == source->size(), "source still counted after eviction");
+}
+
+// The source stops counting once nothing holds it anymore
+void SourceReleasedWithLastHolder() {
+    ResourceRegistry reg;
+
+    const auto nameHash = Hash("bufferA.glsl");
+    {
+        auto source = std::make_shared<const std::string>("void main() {}");
+        reg.addResource("bufferA.glsl", nameHash, 1, std::make_unique<Program>("v1"), source);
+    }
+
+    Expect(reg.memoryUsage() > 0, "published source counted");
+
+    // Pushes the first version out of the history, the last holder of its source
+    for (HashResult hash = 2; hash < 2 + ResourceRegistry::HistoryDepth<Program> + 1; ++hash)
+        reg.addResource("bufferA.glsl", nameHash, hash, std::make_unique<Program>("v"));
+    reg.collectGarbage([](Task&& deleter) { deleter(); });
+
+    Expect(reg.memoryUsage() == 0, "source released with its last holder");
+}
+} // namespace
+
+int main() {
+    // Programs need a context, a headless one is enough
+    glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+    if (!glfwInit())
+        return SkipCode;
+
+    glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+    auto ctx = CreateContext({.backend = ContextBackend::EGL});
+    if (!ctx) {
+        glfwTerminate();
+        return SkipCode;
+    }
+
+    glfwMakeContextCurrent(ctx);
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+        return SkipCode;
+
+    SharedSourceSurvivesEviction();
+    SourceReleasedWithLastHolder();
+
+    glfwDestroyWindow(ctx);
+    glfwTerminate();
+
+    return failures == 0 ? 0 : 1;
+}
\ No newline at end of file